@@ -89,9 +89,14 @@ bool build()
 	nob_cmd_append(&cmd, "-ggdb");
 	nob_cmd_append(&cmd, "-Wall", "-Wpedantic", "-Wextra", "-Werror");
 	nob_cmd_append(&cmd, "-o", "./build/main");
-	nob_cmd_append(&cmd, "./src/main.c", "./src/ed.c", "./src/lb.c");
+	nob_cmd_append(&cmd, "./src/main.c", "./src/ed.c", "./src/lb.c",
+		       "./src/cz.c", "./src/ib.c", "./src/jr.c", "./src/la.c", "./src/ld.c",
+		       "./src/nl.c", "./src/ob.c", "./src/rx.c", "./src/sc.c",
+		       "./src/sp.c");
 #ifdef _WIN32
 	nob_cmd_append(&cmd, "./src/getline.c");
+#else
+	nob_cmd_append(&cmd, "-pthread");
 #endif // _WIN32
 	bool result = nob_cmd_run_sync(cmd);
 	nob_cmd_free(cmd);
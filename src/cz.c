@@ -0,0 +1,187 @@
+#include <errno.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include "./cz.h"
+
+#ifndef _WIN32
+extern char **environ;
+
+static const char *const cz_pigz[] = { "pigz", "-c", NULL };
+static const char *const cz_gzip[] = { "gzip", "-c", NULL };
+static const char *const cz_pigz_d[] = { "pigz", "-dc", NULL };
+static const char *const cz_gzip_d[] = { "gzip", "-dc", NULL };
+static const char *const cz_zstd[] = { "zstd", "-q", "-T0", "-c", NULL };
+static const char *const cz_zstd_d[] = { "zstd", "-q", "-dc", NULL };
+static const char *const cz_xz[] = { "xz", "-T0", "-c", NULL };
+static const char *const cz_xz_d[] = { "xz", "-dc", NULL };
+
+// Every codec there is, which another is added to by adding it here.
+static const Cz_Codec cz_codecs[] = {
+	{ .name = "gzip",
+	  .magic = "\x1f\x8b",
+	  .magic_len = 2,
+	  .extension = ".gz",
+	  .compress = { cz_pigz, cz_gzip },
+	  .decompress = { cz_pigz_d, cz_gzip_d } },
+	{ .name = "zstd",
+	  .magic = "\x28\xb5\x2f\xfd",
+	  .magic_len = 4,
+	  .extension = ".zst",
+	  .compress = { cz_zstd },
+	  .decompress = { cz_zstd_d } },
+	{ .name = "xz",
+	  .magic = "\xfd\x37\x7a\x58\x5a\x00",
+	  .magic_len = 6,
+	  .extension = ".xz",
+	  .compress = { cz_xz },
+	  .decompress = { cz_xz_d } },
+};
+
+#define CZ_CODEC_COUNT (sizeof(cz_codecs) / sizeof(*cz_codecs))
+#endif // _WIN32
+
+const Cz_Codec *cz_detect(int fd)
+{
+#ifdef _WIN32
+	(void)fd;
+	return NULL;
+#else
+	char magic[CZ_MAGIC_MAX];
+	ssize_t size = pread(fd, magic, sizeof(magic), 0);
+
+	for (size_t i = 0; size > 0 && i < CZ_CODEC_COUNT; ++i) {
+		const Cz_Codec *codec = &cz_codecs[i];
+		if ((size_t)size >= codec->magic_len &&
+		    memcmp(magic, codec->magic, codec->magic_len) == 0)
+			return codec;
+	}
+	return NULL;
+#endif // _WIN32
+}
+
+const Cz_Codec *cz_for_path(const char *path)
+{
+#ifdef _WIN32
+	(void)path;
+	return NULL;
+#else
+	size_t len = strlen(path);
+	for (size_t i = 0; i < CZ_CODEC_COUNT; ++i) {
+		const Cz_Codec *codec = &cz_codecs[i];
+		size_t ext_len = strlen(codec->extension);
+		if (len > ext_len &&
+		    strcmp(path + len - ext_len, codec->extension) == 0)
+			return codec;
+	}
+	return NULL;
+#endif // _WIN32
+}
+
+#ifndef _WIN32
+// Start the first of `tools` that can be started, reading from `in` and
+// writing to `out`.
+static bool cz_spawn(const char *const *const *tools, int in, int out,
+		     pid_t *pid)
+{
+	posix_spawn_file_actions_t actions;
+	if (posix_spawn_file_actions_init(&actions) != 0)
+		return false;
+	posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+
+	bool started = false;
+	for (size_t i = 0; !started && i < CZ_TOOLS_MAX; ++i) {
+		if (tools[i] != NULL)
+			started = posix_spawnp(pid, tools[i][0], &actions, NULL,
+					       (char *const *)tools[i],
+					       environ) == 0;
+	}
+
+	posix_spawn_file_actions_destroy(&actions);
+	return started;
+}
+
+// Start the first of `tools` that can be started with a pipe on the side
+// of `ed` given by `reading`, and `file` on the other.
+static bool cz_start(const char *const *const *tools, int file, bool reading,
+		     Cz_Pipe *pipe_out)
+{
+	int ends[2];
+	if (pipe(ends) != 0)
+		return false;
+	// the program mustn't hold on to `ed`'s end, or it never sees the
+	// end of what's written to it
+	fcntl(ends[0], F_SETFD, FD_CLOEXEC);
+	fcntl(ends[1], F_SETFD, FD_CLOEXEC);
+
+	bool started = reading ? cz_spawn(tools, file, ends[1], &pipe_out->pid) :
+				 cz_spawn(tools, ends[0], file, &pipe_out->pid);
+	close(reading ? ends[1] : ends[0]);
+	pipe_out->fd = reading ? ends[0] : ends[1];
+	if (!started) {
+		close(pipe_out->fd);
+		pipe_out->fd = -1;
+		return false;
+	}
+
+	// a program that dies early should fail the write, not end `ed`
+	pipe_out->writing = !reading;
+	if (pipe_out->writing)
+		pipe_out->sigpipe = signal(SIGPIPE, SIG_IGN);
+	return true;
+}
+#endif // _WIN32
+
+bool cz_decompress(const Cz_Codec *codec, int in, Cz_Pipe *pipe)
+{
+#ifdef _WIN32
+	(void)codec;
+	(void)in;
+	(void)pipe;
+	return false;
+#else
+	return cz_start(codec->decompress, in, true, pipe);
+#endif // _WIN32
+}
+
+bool cz_compress(const Cz_Codec *codec, int out, Cz_Pipe *pipe)
+{
+#ifdef _WIN32
+	(void)codec;
+	(void)out;
+	(void)pipe;
+	return false;
+#else
+	return cz_start(codec->compress, out, false, pipe);
+#endif // _WIN32
+}
+
+bool cz_finish(Cz_Pipe *pipe)
+{
+#ifdef _WIN32
+	(void)pipe;
+	return false;
+#else
+	if (pipe->fd >= 0)
+		close(pipe->fd);
+	pipe->fd = -1;
+
+	int status;
+	pid_t waited;
+	while ((waited = waitpid(pipe->pid, &status, 0)) < 0 && errno == EINTR)
+		;
+	if (pipe->writing)
+		signal(SIGPIPE, pipe->sigpipe);
+
+	return waited == pipe->pid && WIFEXITED(status) &&
+	       WEXITSTATUS(status) == 0;
+#endif // _WIN32
+}
@@ -0,0 +1,72 @@
+#ifndef CZ_H_
+#define CZ_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Compressed files, which are read and written through the programs that
+// handle them, so that lines stream in and out of them without a
+// decompressed copy ever being put on disk.
+//
+// Each codec lists the programs that can handle it, tried in order, with the
+// ones that compress on several threads first.
+
+// Most programs a codec can be handled by.
+#define CZ_TOOLS_MAX 2
+
+// Most bytes a codec's magic takes.
+#define CZ_MAGIC_MAX 8
+
+// A compression format.
+typedef struct {
+	const char *name;
+	// bytes the format's files start with
+	const char *magic;
+	size_t magic_len;
+	// extension of files written in the format
+	const char *extension;
+	// commands which compress from standard input to standard output, or
+	// the other way around
+	const char *const *compress[CZ_TOOLS_MAX];
+	const char *const *decompress[CZ_TOOLS_MAX];
+} Cz_Codec;
+
+// A program a file is piped through.
+typedef struct {
+	pid_t pid;
+	// end of the pipe which is read from or written to
+	int fd;
+	bool writing;
+	// what was done on `SIGPIPE` before a program being written to was
+	// started
+	void (*sigpipe)(int);
+} Cz_Pipe;
+
+// Codec of the file `fd`, going by the bytes it starts with, or `NULL` if
+// it isn't compressed.
+const Cz_Codec *cz_detect(int fd);
+
+// Codec the file at `path` is written with, going by its extension, or
+// `NULL` if it's written as is.
+const Cz_Codec *cz_for_path(const char *path);
+
+// Start decompressing the file `in` with `codec`, setting `pipe` to the
+// program that reads it and the end of the pipe to read from.
+//
+// Returns `false` if no program for `codec` could be started.
+bool cz_decompress(const Cz_Codec *codec, int in, Cz_Pipe *pipe);
+
+// Start compressing into the file `out` with `codec`, setting `pipe` to the
+// program that writes it and the end of the pipe to write to.
+//
+// Returns `false` if no program for `codec` could be started.
+bool cz_compress(const Cz_Codec *codec, int out, Cz_Pipe *pipe);
+
+// Close the pipe of `pipe`, unless it was already closed and set to -1, and
+// wait for its program to be done.
+//
+// Returns whether the program succeeded.
+bool cz_finish(Cz_Pipe *pipe);
+
+#endif // CZ_H_
@@ -1,9 +1,24 @@
 #include <assert.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
-
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "./cz.h"
+#include "./ib.h"
+#include "./jr.h"
+#include "./la.h"
+#include "./ld.h"
 #include "./lb.h"
+#include "./nl.h"
+#include "./ob.h"
+#include "./rx.h"
+#include "./sc.h"
+#include "./sp.h"
 #include "./ed.h"
 
 // STRING UTILS
@@ -25,26 +40,6 @@ char *trim(char *s)
 	return s;
 }
 
-// Dynamically concatenate two strings, returning the result.
-//
-// The returned string is allocated with `calloc` and needs to be freed.
-char *strappend(char *a, char *b)
-{
-	int sizea = strlen(a);
-	int sizeb = strlen(b);
-	int size = sizea + sizeb + 1;
-
-	char *s = calloc(size, sizeof(char));
-
-	for (int i = 0; i < sizea; ++i)
-		s[i] = a[i];
-
-	for (int i = 0; i <= sizeb; ++i)
-		s[sizea + i] = b[i];
-
-	return s;
-}
-
 // COMMANDS
 
 // Enumeration of all possible `ed` commands.
@@ -54,16 +49,23 @@ typedef enum {
 	ED_CMD_DELETE,
 	ED_CMD_EDIT,
 	ED_CMD_FORCE_QUIT,
+	ED_CMD_GLOBAL,
+	ED_CMD_GLOBAL_INVERSE,
 	ED_CMD_INSERT,
 	ED_CMD_JOIN,
 	ED_CMD_LAST_ERR,
+	ED_CMD_LOAD_PROGRESS,
+	ED_CMD_MARK,
 	ED_CMD_MOVE,
 	ED_CMD_PRINT,
 	ED_CMD_PRINT_NUM,
 	ED_CMD_PUT,
 	ED_CMD_QUIT,
+	ED_CMD_READ,
+	ED_CMD_SUBSTITUTE,
 	ED_CMD_TOGGLE_ERR,
 	ED_CMD_TOGGLE_PROMPT,
+	ED_CMD_TRANSFER,
 	ED_CMD_UNDO,
 	ED_CMD_WRITE,
 	ED_CMD_INVALID,
@@ -94,6 +96,9 @@ typedef union {
 typedef struct {
 	Ed_Address_Position position;
 	Ed_Address_Type type;
+	// whether the address was written out, rather than standing for the
+	// current line
+	bool given;
 } Ed_Address;
 
 // Convert a line number to an index within the buffer.
@@ -107,69 +112,524 @@ typedef enum {
 	ED_ERROR_INVALID_ADDRESS,
 	ED_ERROR_INVALID_COMMAND,
 	ED_ERROR_INVALID_FILE,
+	ED_ERROR_INVALID_JOURNAL,
+	ED_ERROR_INVALID_MARK,
+	ED_ERROR_INVALID_PATTERN,
+	ED_ERROR_JOURNAL_EXISTS,
+	ED_ERROR_NO_MATCH,
+	ED_ERROR_NO_PREVIOUS_PATTERN,
+	ED_ERROR_NO_PUT,
 	ED_ERROR_NO_UNDO,
+	ED_ERROR_STALE_JOURNAL,
 	ED_ERROR_UNSAVED_CHANGES,
 	ED_ERROR_UNKNOWN,
 } Ed_Error;
 
+// UNDO
+
+// A single change made to the buffer.
+//
+// `removed` lines were taken out of the buffer at `index` (and are kept in the
+// undo's `lines`), and `inserted` lines were put in their place.
+//
+// A `rotated` step removes nothing: the `removed` lines at `index` traded
+// places with the `inserted` lines right after them.
+typedef struct {
+	size_t index;
+	size_t removed;
+	size_t inserted;
+	bool rotated;
+} Ed_Undo_Step;
+
+// Amount of marks, one for each lowercase letter.
+#define ED_MARKS_CAP 26
+
+// A mark on a line that a step removed, which undoing the step puts back.
+typedef struct {
+	// number of the step, counting from 1, or 0 if no step removed the
+	// marked line
+	size_t step;
+	// the marked line, counting from the step's `index`
+	size_t offset;
+} Ed_Undo_Mark;
+
+// All of the changes made by the last command that modified the buffer.
+typedef struct {
+	da(Ed_Undo_Step) steps;
+	// marks dropped by the steps, by letter
+	Ed_Undo_Mark marks[ED_MARKS_CAP];
+	// the removed lines of all steps, in the order the steps were made
+	Line_Builder lines;
+	// `change_id` and `line` from before the command
+	size_t change_id;
+	size_t line;
+	// lines of `lines` from `yank_start` on which the yank register stands
+	// for while it's empty, so that deleted lines are only held once
+	size_t yank_start;
+	size_t yank_count;
+	// whether steps are still being recorded for the current command
+	bool open;
+} Ed_Undo;
+
+// Free the steps and lines held by `undo`.
+void ed_undo_free(Ed_Undo *undo)
+{
+	lb_free(&undo->lines);
+	free(undo->steps.items);
+	memset(undo, 0, sizeof(*undo));
+}
+
+// GLOBAL COMMANDS
+
+// Value of marks whose line was removed by the command list.
+#define ED_GLOBAL_UNMARKED SIZE_MAX
+
+// Lines marked by a running `g` or `v` command, in ascending order.
+//
+// The marks from `next` on are yet to be visited. Changes to the buffer before
+// all of them only add to `shift`, rather than updating each mark.
+typedef struct {
+	Sc_Marks marks;
+	size_t next;
+	// amount added to the marks from `next` on
+	ssize_t shift;
+	// whether moving lines left the marks out of order, in which case each
+	// one is updated on every change
+	bool unordered;
+	bool active;
+} Ed_Global;
+
+// Update the marks yet to be visited by `global`, after `removed` lines at
+// `index` were replaced by `inserted` lines.
+void ed_global_adjust(Ed_Global *global, size_t index, size_t removed,
+		      size_t inserted)
+{
+	if (!global->active || global->next == global->marks.count)
+		return;
+
+	size_t *marks = global->marks.items;
+	ssize_t delta = (ssize_t)inserted - (ssize_t)removed;
+
+	size_t first = marks[global->next];
+	if (!global->unordered && first != ED_GLOBAL_UNMARKED &&
+	    index + removed <= first + global->shift) {
+		global->shift += delta;
+		return;
+	}
+
+	for (size_t i = global->next; i < global->marks.count; ++i) {
+		if (marks[i] == ED_GLOBAL_UNMARKED)
+			continue;
+
+		size_t mark = marks[i] + global->shift;
+		if (mark >= index + removed)
+			mark += delta;
+		else if (mark >= index)
+			mark = ED_GLOBAL_UNMARKED;
+		marks[i] = mark;
+	}
+	global->shift = 0;
+}
+
+// Update the marks yet to be visited by `global`, after the `removed` lines at
+// `index` traded places with the `inserted` lines after them.
+void ed_global_rotate(Ed_Global *global, size_t index, size_t removed,
+		      size_t inserted)
+{
+	if (!global->active || global->next == global->marks.count)
+		return;
+
+	size_t *marks = global->marks.items;
+	size_t middle = index + removed;
+	size_t last = middle + inserted;
+
+	// lines moved around before any of the marks leave them as they are
+	size_t first = marks[global->next];
+	if (!global->unordered && first != ED_GLOBAL_UNMARKED &&
+	    last <= first + global->shift)
+		return;
+
+	size_t previous = 0;
+	for (size_t i = global->next; i < global->marks.count; ++i) {
+		if (marks[i] == ED_GLOBAL_UNMARKED)
+			continue;
+
+		size_t mark = marks[i] + global->shift;
+		if (mark >= index && mark < middle)
+			mark += inserted;
+		else if (mark >= middle && mark < last)
+			mark -= removed;
+
+		if (mark < previous)
+			global->unordered = true;
+		previous = mark;
+		marks[i] = mark;
+	}
+	global->shift = 0;
+}
+
+// MARKS
+
+// Lines marked with `k`, by the number of the line each letter marks, or 0 for
+// letters that mark nothing.
+//
+// Marks follow their lines through every change made to the buffer, which
+// costs a single update per mark rather than anything per line.
+typedef struct {
+	size_t lines[ED_MARKS_CAP];
+} Ed_Marks;
+
+// Update `marks` after `step` was made to the buffer, as part of the last
+// step of `undo`.
+//
+// Marks on lines that were removed are dropped, and kept by `undo` so that
+// undoing the step puts them back.
+void ed_marks_adjust(Ed_Marks *marks, Ed_Undo_Step step, Ed_Undo *undo)
+{
+	size_t number = undo->steps.count;
+	size_t base = undo->steps.items[number - 1].index;
+
+	size_t middle = step.index + step.removed;
+	for (size_t i = 0; i < ED_MARKS_CAP; ++i) {
+		if (marks->lines[i] == 0)
+			continue;
+
+		size_t index = marks->lines[i] - 1;
+		if (step.rotated) {
+			if (index >= step.index && index < middle)
+				index += step.inserted;
+			else if (index >= middle &&
+				 index < middle + step.inserted)
+				index -= step.removed;
+		} else if (index >= middle) {
+			index = index + step.inserted - step.removed;
+		} else if (index >= step.index) {
+			undo->marks[i] = (Ed_Undo_Mark){ .step = number,
+							 .offset = index - base };
+			marks->lines[i] = 0;
+			continue;
+		}
+		marks->lines[i] = index + 1;
+	}
+}
+
+// Put back the marks `undo` kept for its step `number`, once its removed lines
+// are back in the buffer at `index`.
+//
+// Letters marked again since are left as they are.
+void ed_marks_restore(Ed_Marks *marks, const Ed_Undo *undo, size_t number,
+		      size_t index)
+{
+	for (size_t i = 0; i < ED_MARKS_CAP; ++i) {
+		if (undo->marks[i].step == number && marks->lines[i] == 0)
+			marks->lines[i] = index + undo->marks[i].offset + 1;
+	}
+}
+
 // CONTEXT
 
+// Nanoseconds of the time the file `st` was last modified at, which tell
+// apart changes made within the same second.
+#if defined(_WIN32)
+#define ED_MTIME_NSEC(st) 0L
+#elif defined(__APPLE__)
+#define ED_MTIME_NSEC(st) ((long)(st).st_mtimespec.tv_nsec)
+#else
+#define ED_MTIME_NSEC(st) ((long)(st).st_mtim.tv_nsec)
+#endif // _WIN32
+
+// The file the buffer was last loaded from or written to, which lets `w`
+// rewrite only what changed since.
+typedef struct {
+	// whether the buffer's lines up to `dirty` point straight into the
+	// file, one after the other from its start
+	bool valid;
+	La_File file;
+	size_t size;
+	time_t mtime;
+	long mtime_nsec;
+	// index of the first line changed since, or `SIZE_MAX` if none was
+	size_t dirty;
+} Ed_Saved;
+
 // Struct with all of the global context for the application.
 typedef struct {
+	Ed_Options options;
 	Line_Builder buffer;
+	// amount of changes ever made to the buffer, which never goes down
 	size_t change_count;
-	Line_Builder back_buf;
-	size_t back_changes;
+	// what the buffer holds, as `change_count` after the change that
+	// made it so, and that as of when it was last saved
+	size_t change_id;
+	size_t saved_id;
+	Ed_Undo undo;
+	Ed_Saved saved;
 
 	size_t line;
 	char *filename;
+	// last pattern searched for, which an empty pattern stands for
+	char *pattern;
 	Line_Builder yank_register;
+	Ed_Marks marks;
+	Ed_Global global;
 	Ed_Error error;
 	bool prompt;
 	bool should_print_error;
 } Ed_Context;
 
 // Instance of `Ed_Context` that is shared globally.
-static Ed_Context ed_global_context = { .buffer = { 0 },
+static Ed_Context ed_global_context = { .options = { .sync = true },
+					.buffer = { 0 },
 					.change_count = 0,
-					.back_buf = { 0 },
-					.back_changes = 0,
+					.change_id = 0,
+					.saved_id = 0,
+					.undo = { .steps = { 0 } },
+					.saved = { .valid = false },
 
 					.line = 0,
 					.yank_register = { 0 },
+					.marks = { { 0 } },
+					.global = { .marks = { 0 } },
 					.filename = 0,
+					.pattern = 0,
 					.error = ED_ERROR_NO_ERROR,
 					.prompt = false,
 					.should_print_error = false };
 
+// Whether the global context's buffer was changed since it was last saved,
+// which is only warned about once.
+bool ed_context_warn_unsaved(void)
+{
+	Ed_Context *context = &ed_global_context;
+
+	if (context->change_id == context->saved_id)
+		return false;
+	context->saved_id = context->change_id;
+	return true;
+}
+
+// Value of `line` standing for the last line of the buffer, which isn't known
+// until the file being loaded in the background is fully loaded.
+#define ED_LINE_LAST SIZE_MAX
+
+// Hand the lines loaded in the background so far over to the end of the
+// global context's buffer, first waiting until it holds at least `count`
+// lines or the file is fully loaded.
+void ed_load_until(size_t count)
+{
+	Line_Builder *buffer = &ed_global_context.buffer;
+
+	while (ld_loading()) {
+		ld_take(buffer, count > buffer->count ? count - buffer->count : 0);
+		if (buffer->count >= count)
+			return;
+	}
+}
+
+// Get the global context's current line, waiting for the whole file to be
+// loaded if it's the last line.
+size_t ed_context_line(void)
+{
+	Ed_Context *context = &ed_global_context;
+
+	if (context->line == ED_LINE_LAST) {
+		ed_load_until(SIZE_MAX);
+		context->line = context->buffer.count;
+	}
+	return context->line;
+}
+
+// Hand the yank register the lines of the undo it stands for, moving them out
+// of the undo if `move` is set as it's about to be freed, or sharing them
+// otherwise.
+void ed_context_yank_keep(bool move)
+{
+	Ed_Context *context = &ed_global_context;
+	Ed_Undo *undo = &context->undo;
+
+	if (undo->yank_count == 0)
+		return;
+
+	size_t end = undo->yank_start + undo->yank_count - 1;
+	if (move)
+		lb_take(&undo->lines, undo->yank_start, end,
+			&context->yank_register);
+	else
+		lb_copy(&undo->lines, undo->yank_start, end,
+			&context->yank_register);
+	undo->yank_count = 0;
+}
+
+// Record `step` as a change to the global context's buffer, returning where
+// it was recorded.
+//
+// The first change made by a command replaces the previous command's undo.
+Ed_Undo_Step *ed_context_record_step(Ed_Undo_Step step)
+{
+	Ed_Context *context = &ed_global_context;
+	Ed_Undo *undo = &context->undo;
+
+	if (!undo->open) {
+		ed_context_yank_keep(true);
+		ed_undo_free(undo);
+		undo->change_id = context->change_id;
+		undo->line = context->line;
+		undo->open = true;
+	}
+
+	da_append(&undo->steps, step);
+	ed_marks_adjust(&context->marks, step, undo);
+	if (step.rotated)
+		ed_global_rotate(&context->global, step.index, step.removed,
+				 step.inserted);
+	else
+		ed_global_adjust(&context->global, step.index, step.removed,
+				 step.inserted);
+
+	if (step.index < context->saved.dirty)
+		context->saved.dirty = step.index;
+
+	context->change_count += 1;
+	context->change_id = context->change_count;
+	return &undo->steps.items[undo->steps.count - 1];
+}
+
+// Record a change to the global context's buffer, returning the new step.
+Ed_Undo_Step *ed_context_record(size_t index, size_t removed,
+				size_t inserted)
+{
+	Ed_Undo_Step step = { .index = index,
+			      .removed = removed,
+			      .inserted = inserted };
+	return ed_context_record_step(step);
+}
+
+// Journal `step`, once it was made to the global context's buffer.
+void ed_context_journal(Ed_Undo_Step step)
+{
+	size_t middle = step.index + step.removed;
+	if (step.rotated)
+		jr_move(step.index, middle, middle + step.inserted);
+	else
+		jr_change(step.index, step.removed, &ed_global_context.buffer,
+			  step.inserted);
+}
+
 // Like `lb_pop` for the global context's buffer.
 void ed_context_pop(size_t start, size_t end)
 {
 	Ed_Context *context = &ed_global_context;
-	lb_clone(&context->buffer, &context->back_buf);
-	context->back_changes = context->change_count;
-	lb_pop(&context->buffer, start, end);
-	context->change_count += 1;
+	Ed_Undo_Step *step = ed_context_record(start, end + 1 - start, 0);
+	lb_take(&context->buffer, start, end, &context->undo.lines);
+	ed_context_journal(*step);
+}
+
+// Like `lb_take_many` for the global context's buffer, taking the lines at
+// the `count` ascending `indices` into the undo.
+void ed_context_pop_many(const size_t *indices, size_t count)
+{
+	Ed_Context *context = &ed_global_context;
+
+	// each run of lines is recorded where it is once the runs before it
+	// are gone
+	size_t taken = 0;
+	for (size_t i = 0; i < count;) {
+		size_t run = 1;
+		while (i + run < count && indices[i + run] == indices[i] + run)
+			run += 1;
+
+		// removals don't need the lines to journal them, so they can
+		// be journaled before they're made
+		ed_context_journal(*ed_context_record(indices[i] - taken, run, 0));
+		taken += run;
+		i += run;
+	}
+
+	lb_take_many(&context->buffer, indices, count, &context->undo.lines);
 }
 
 // Like `lb_insert` for the global context's buffer.
 void ed_context_insert(Line_Builder *lb, size_t index)
 {
 	Ed_Context *context = &ed_global_context;
-	lb_clone(&context->buffer, &context->back_buf);
-	context->back_changes = context->change_count;
+	Ed_Undo_Step *step = ed_context_record(index, 0, lb->count);
 	lb_insert(&context->buffer, lb, index);
-	context->change_count += 1;
+	ed_context_journal(*step);
 }
 
-// Like `lb_overwrite` for the global context's buffer.
+// Like `lb_rotate` for the global context's buffer.
+void ed_context_rotate(size_t first, size_t middle, size_t last)
+{
+	Ed_Context *context = &ed_global_context;
+	Ed_Undo_Step step = { .index = first,
+			      .removed = middle - first,
+			      .inserted = last - middle,
+			      .rotated = true };
+	ed_context_record_step(step);
+	lb_rotate(&context->buffer, first, middle, last);
+	ed_context_journal(step);
+}
+
+// Replace the lines between `start` and `end` in the global context's buffer
+// with the contents of `lb`.
 void ed_context_overwrite(Line_Builder *lb, size_t start, size_t end)
 {
 	Ed_Context *context = &ed_global_context;
-	lb_clone(&context->buffer, &context->back_buf);
-	context->back_changes = context->change_count;
-	lb_overwrite(&context->buffer, lb, start, end);
-	context->change_count += 1;
+	Ed_Undo_Step *step =
+		ed_context_record(start, end + 1 - start, lb->count);
+	lb_take(&context->buffer, start, end, &context->undo.lines);
+	lb_insert(&context->buffer, lb, start);
+	ed_context_journal(*step);
+}
+
+// Replace the line in the global context's buffer which `it` was last on,
+// at `index`, with `line` of length `len`.
+//
+// Lines replaced one after the other share a single undo step.
+void ed_context_replace(Lb_Iter *it, size_t index, char *line, size_t len)
+{
+	Ed_Context *context = &ed_global_context;
+	Ed_Undo *undo = &context->undo;
+
+	Ed_Undo_Step *last = undo->open && undo->steps.count > 0 ?
+				     &undo->steps.items[undo->steps.count - 1] :
+				     NULL;
+	if (last != NULL && !last->rotated &&
+	    last->removed == last->inserted &&
+	    last->index + last->inserted == index) {
+		last->removed += 1;
+		last->inserted += 1;
+
+		Ed_Undo_Step step = { .index = index,
+				      .removed = 1,
+				      .inserted = 1 };
+		ed_marks_adjust(&context->marks, step, undo);
+	} else {
+		ed_context_record(index, 1, 1);
+	}
+
+	size_t old_len;
+	char *old = lb_iter_swap(&context->buffer, it, line, len, &old_len);
+	lb_append(&undo->lines, old, old_len);
+
+	Ed_Undo_Step step = { .index = index, .removed = 1, .inserted = 1 };
+	ed_context_journal(step);
+}
+
+// Replace the contents of the yank register with the last `count` lines the
+// undo took out of the global context's buffer.
+//
+// The undo keeps owning the lines, and only hands them to the register once
+// it's done with them, so that deleting any amount of lines doesn't touch
+// each of them.
+void ed_context_yank(size_t count)
+{
+	Ed_Context *context = &ed_global_context;
+	Ed_Undo *undo = &context->undo;
+
+	lb_clear(&context->yank_register);
+	undo->yank_start = undo->lines.count - count;
+	undo->yank_count = count;
 }
 
 // Sets the global context's error.
@@ -188,46 +648,189 @@ void ed_context_set_error(Ed_Error error)
 
 // PARSING
 
+// Parse a pattern delimited by `delimiter` from user input, and compile it.
+//
+// The closing delimiter may be left out at the end of the line, and an empty
+// pattern stands for the last one used.
+// Returns `NULL` and sets the global context's error upon failure.
+// `line` is updated to point to after the closing delimiter.
+Rx *ed_parse_pattern(char **line, char delimiter)
+{
+	Ed_Context *context = &ed_global_context;
+
+	char *c = *line;
+	char *pattern = malloc(strlen(c) + 1);
+	assert(pattern != NULL && "Could not allocate memory");
+
+	size_t len = 0;
+	for (; *c != delimiter && *c != '\n' && *c != '\0'; c++) {
+		// an escaped delimiter is part of the pattern, while any other
+		// escape is left for the regex to handle
+		if (*c == '\\' && c[1] == delimiter)
+			c += 1;
+		else if (*c == '\\' && c[1] != '\n' && c[1] != '\0')
+			pattern[len++] = *c++;
+		pattern[len++] = *c;
+	}
+	pattern[len] = '\0';
+	if (*c == delimiter)
+		c += 1;
+	*line = c;
+
+	if (len == 0) {
+		free(pattern);
+		if (context->pattern == NULL) {
+			ed_context_set_error(ED_ERROR_NO_PREVIOUS_PATTERN);
+			return NULL;
+		}
+		pattern = context->pattern;
+	}
+
+	Rx *rx = rx_compile(pattern);
+	if (rx == NULL) {
+		if (pattern != context->pattern)
+			free(pattern);
+		ed_context_set_error(ED_ERROR_INVALID_PATTERN);
+		return NULL;
+	}
+
+	// only a pattern that compiles is the one an empty pattern stands for
+	if (pattern != context->pattern) {
+		free(context->pattern);
+		context->pattern = pattern;
+	}
+	return rx;
+}
+
+// Search the buffer for the first line matching `rx` after the current line,
+// or before it if not `forward`, wrapping around at the ends of the buffer.
+//
+// Returns the line number, or 0 if no line matches.
+size_t ed_search(Rx *rx, bool forward)
+{
+	Ed_Context *context = &ed_global_context;
+	Line_Builder *buffer = &context->buffer;
+
+	// searches wrap around, so they need every line
+	ed_load_until(SIZE_MAX);
+	size_t count = buffer->count;
+	if (count == 0)
+		return 0;
+
+	// the buffer is split around the current line, and the part the search
+	// starts in is scanned first
+	size_t current = ed_context_line();
+	size_t line = current < count ? current : count;
+	size_t found = SC_NOT_FOUND;
+	if (forward) {
+		if (line < count)
+			found = sc_find(buffer, rx, line, count - 1, true);
+		if (found == SC_NOT_FOUND && line > 0)
+			found = sc_find(buffer, rx, 0, line - 1, true);
+	} else {
+		if (line > 1)
+			found = sc_find(buffer, rx, 0, line - 2, false);
+		if (found == SC_NOT_FOUND)
+			found = sc_find(buffer, rx, line > 0 ? line - 1 : 0,
+					count - 1, false);
+	}
+
+	return found == SC_NOT_FOUND ? 0 : found + 1;
+}
+
+// Parse a single line number from user input, written as a number, `.`, `$`,
+// a mark as `'x`, or a pattern to search for between `/`s (forward) or `?`s
+// (backward).
+//
+// Sets `found` to whether there is a line number at all.
+// Returns `false` and sets the global context's error upon failure.
+// `line` is updated to point to after the line number.
+bool ed_parse_line(char **line, size_t *result, bool *found)
+{
+	Ed_Context *context = &ed_global_context;
+
+	char *c = *line;
+	*found = true;
+
+	if (isdigit(*c)) {
+		*result = 0;
+		for (; isdigit(*c); c++) {
+			*result *= 10;
+			*result += *c - '0';
+		}
+	} else if (*c == '.') {
+		*result = ed_context_line();
+		c += 1;
+	} else if (*c == '$') {
+		ed_load_until(SIZE_MAX);
+		*result = context->buffer.count;
+		c += 1;
+	} else if (*c == '\'') {
+		c += 1;
+		if (!islower(*c)) {
+			ed_context_set_error(ED_ERROR_INVALID_MARK);
+			return false;
+		}
+
+		*result = context->marks.lines[*c - 'a'];
+		if (*result == 0) {
+			ed_context_set_error(ED_ERROR_INVALID_ADDRESS);
+			return false;
+		}
+		c += 1;
+	} else if (*c == '/' || *c == '?') {
+		char delimiter = *c;
+		c += 1;
+		Rx *rx = ed_parse_pattern(&c, delimiter);
+		if (rx == NULL)
+			return false;
+
+		*result = ed_search(rx, delimiter == '/');
+		if (*result == 0) {
+			ed_context_set_error(ED_ERROR_NO_MATCH);
+			return false;
+		}
+	} else {
+		*found = false;
+	}
+
+	*line = c;
+	return true;
+}
+
 // Parse an address from user input.
 //
-// Returns an address with type `ED_ADDRESS_INVALID` upon failure.
+// Returns an address with type `ED_ADDRESS_INVALID` and sets the global
+// context's error upon failure.
 // `line` is updated to point to after the address specifier.
-// TODO: rewrite this to be more readable and to handle other cases
 Ed_Address ed_parse_address(char **line)
 {
 	Ed_Address address = { 0 };
 	Ed_Context *context = &ed_global_context;
 
-	Ed_Address_Type result;
+	Ed_Address_Type result = ED_ADDRESS_INVALID;
 
 	char *c = *line;
-	bool any = false;
+	bool found;
 
-	size_t start = 0;
-	for (; isdigit(*c); c++) {
-		any = true;
-		start *= 10;
-		start += *c - '0';
-	}
+	size_t start;
+	if (!ed_parse_line(&c, &start, &found))
+		goto defer;
 
-	if (!any) {
-		if (*c == '.') {
-			start = context->line;
-			c += 1;
-		} else if (*c == '$') {
-			start = context->buffer.count;
-			c += 1;
-		} else if (*c == ',') {
+	address.given = found || *c == ',';
+	if (!found) {
+		if (*c == ',') {
+			ed_load_until(SIZE_MAX);
 			address.position.as_range.start = 1;
 			address.position.as_range.end = context->buffer.count;
 			c += 1;
 			result = ED_ADDRESS_RANGE;
-			goto defer;
 		} else {
+			// looked up by `ed_run_cmd` for the commands that need it
 			address.position.as_line = context->line;
 			result = ED_ADDRESS_LINE;
-			goto defer;
 		}
+		goto defer;
 	}
 
 	if (*c != ',') {
@@ -238,30 +841,13 @@ Ed_Address ed_parse_address(char **line)
 
 	// remove ','
 	c += 1;
-	any = false;
-
-	size_t end = 0;
-	for (; isdigit(*c); c++) {
-		any = true;
-		end *= 10;
-		end += *c - '0';
-	}
 
-	if (!any) {
-		if (*c == '.') {
-			end = context->line;
-			c += 1;
-		} else if (*c == '$') {
-			end = context->buffer.count - 1;
-			c += 1;
-		} else {
-			result = ED_ADDRESS_INVALID;
-			goto defer;
-		}
-	}
+	size_t end;
+	if (!ed_parse_line(&c, &end, &found))
+		goto defer;
 
-	if (start > end) {
-		result = ED_ADDRESS_INVALID;
+	if (!found || start > end) {
+		ed_context_set_error(ED_ERROR_INVALID_ADDRESS);
 		goto defer;
 	}
 
@@ -299,6 +885,9 @@ Ed_Cmd_Type ed_parse_cmd_type(char **line)
 		*line += 1;
 		*line = trim(*line);
 		return ED_CMD_EDIT;
+	case 'g':
+		*line += 1;
+		return ED_CMD_GLOBAL;
 	case 'h':
 		return ED_CMD_LAST_ERR;
 	case 'H':
@@ -307,6 +896,11 @@ Ed_Cmd_Type ed_parse_cmd_type(char **line)
 		return ED_CMD_INSERT;
 	case 'j':
 		return ED_CMD_JOIN;
+	case 'k':
+		*line += 1;
+		return ED_CMD_MARK;
+	case 'L':
+		return ED_CMD_LOAD_PROGRESS;
 	case 'm':
 		*line += 1;
 		return ED_CMD_MOVE;
@@ -323,8 +917,21 @@ Ed_Cmd_Type ed_parse_cmd_type(char **line)
 		return ED_CMD_QUIT;
 	case 'Q':
 		return ED_CMD_FORCE_QUIT;
+	case 'r':
+		*line += 1;
+		*line = trim(*line);
+		return ED_CMD_READ;
+	case 's':
+		*line += 1;
+		return ED_CMD_SUBSTITUTE;
+	case 't':
+		*line += 1;
+		return ED_CMD_TRANSFER;
 	case 'u':
 		return ED_CMD_UNDO;
+	case 'v':
+		*line += 1;
+		return ED_CMD_GLOBAL_INVERSE;
 	case 'w':
 		*line += 1;
 		*line = trim(*line);
@@ -343,6 +950,12 @@ bool address_out_of_range(Ed_Address address, bool allow_zero)
 {
 	Ed_Context *context = &ed_global_context;
 
+	// lines still being loaded may yet bring the address in range
+	if (address.type != ED_ADDRESS_INVALID)
+		ed_load_until(address.type == ED_ADDRESS_LINE ?
+				      address.position.as_line :
+				      address.position.as_range.end);
+
 	switch (address.type) {
 	case ED_ADDRESS_LINE: {
 		if (address.position.as_line == 0)
@@ -407,17 +1020,12 @@ bool ed_cmd_change(Ed_Address address)
 		ed_return_error(ED_ERROR_UNKNOWN);
 	}
 
-	if (context->yank_register.items != NULL) {
-		lb_clear(context->yank_register);
-	}
-
 	if (address.type == ED_ADDRESS_LINE) {
 		size_t start = line_to_index(address.position.as_line);
 
 		size_t amount = lb.count - 1;
-		lb_append(&context->yank_register,
-			  strdup(context->buffer.items[start]));
 		ed_context_overwrite(&lb, start, start);
+		ed_context_yank(1);
 		context->line = address.position.as_line + amount;
 	} else {
 		size_t start = line_to_index(address.position.as_range.start);
@@ -425,12 +1033,8 @@ bool ed_cmd_change(Ed_Address address)
 
 		size_t amount = lb.count - (end - start);
 
-		for (size_t i = start; i <= end; ++i) {
-			lb_append(&context->yank_register,
-				  strdup(context->buffer.items[i]));
-		}
-
 		ed_context_overwrite(&lb, start, end);
+		ed_context_yank(end + 1 - start);
 		context->line = address.position.as_range.start + amount;
 	}
 
@@ -445,87 +1049,410 @@ bool ed_cmd_delete(Ed_Address address)
 		ed_return_error(ED_ERROR_INVALID_ADDRESS);
 	}
 
+	size_t start, end;
 	if (address.type == ED_ADDRESS_LINE) {
-		if (context->yank_register.items != NULL) {
-			lb_clear(context->yank_register);
-		}
-
-		size_t start = line_to_index(address.position.as_line);
-
-		lb_append(&context->yank_register,
-			  strdup(context->buffer.items[start]));
-		ed_context_pop(start, start);
+		start = end = line_to_index(address.position.as_line);
 	} else {
-		if (context->yank_register.items != NULL) {
-			lb_clear(context->yank_register);
-		}
+		start = line_to_index(address.position.as_range.start);
+		end = line_to_index(address.position.as_range.end);
+	}
 
-		size_t start = line_to_index(address.position.as_range.start);
-		size_t end = address.position.as_range.end;
-		for (size_t i = start; i < end; ++i) {
-			lb_append(&context->yank_register,
-				  strdup(context->buffer.items[i]));
-		}
+	ed_context_pop(start, end);
+	ed_context_yank(end + 1 - start);
 
-		ed_context_pop(start, end - 1);
-	}
+	// the line after the deleted ones becomes the current one, or the last
+	// line if they were at the end
+	ed_load_until(start + 1);
+	size_t count = context->buffer.count;
+	context->line = start < count ? start + 1 : count;
 
 	return true;
 }
 
-bool ed_cmd_edit(char *line)
+// Print the amount of bytes a file command read or wrote, unless running a
+// script.
+void ed_print_size(size_t bytes)
 {
 	Ed_Context *context = &ed_global_context;
+	if (context->options.script)
+		return;
 
-	context->filename = strdup(line);
+	ob_size(bytes);
+	ob_putc('\n');
+}
 
-	FILE *f = fopen(line, "r");
-	if (f == NULL) {
-		context->change_count++;
-		printf("%s: No such file or directory\n", line);
-		ed_return_error(ED_ERROR_INVALID_FILE);
-	}
+// Remember the file at `path` as the one the global context's buffer was
+// loaded from or written to, journaling the changes made since against it,
+// and comparing against it on write if the buffer's lines point straight
+// into it.
+//
+// A journal left behind for the file as it was before it changed is replaced,
+// with a warning unless running a script.
+//
+// Returns `false` if the file's journal was left behind by another `ed`, and
+// the changes made since aren't journaled.
+bool ed_context_saved(const char *path)
+{
+	Ed_Context *context = &ed_global_context;
+	Ed_Saved *saved = &context->saved;
 
-	ssize_t result = lb_read_file(&context->buffer, f);
-	context->line = context->buffer.count > 0 ? context->buffer.count - 1 :
-						    0;
-	fclose(f);
+	saved->valid = false;
+	saved->dirty = SIZE_MAX;
 
-	if (result < 0) {
-		ed_return_error(ED_ERROR_UNKNOWN);
+	struct stat st;
+	// only a regular file is there to be recovered or compared against
+	if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+		jr_stop();
+		return true;
+	}
+	Jr_Start journal =
+		jr_start(path, st.st_size, st.st_mtime, ED_MTIME_NSEC(st));
+	bool journaled = journal != JR_KEPT;
+	if (journal == JR_DISCARDED && !context->options.script) {
+		ob_puts(path);
+		ob_puts(JR_SUFFIX ": Discarded, the file changed since\n");
 	}
 
-	printf(PRISize "\n", result);
-
-	return true;
+	size_t len, offset;
+	if (context->buffer.count == 0 ||
+	    !la_map_offset(lb_get(&context->buffer, 0, &len), &saved->file,
+			   &offset))
+		return journaled;
+
+	saved->valid = offset == 0 && saved->file.dev == st.st_dev &&
+		       saved->file.ino == st.st_ino;
+	saved->size = st.st_size;
+	saved->mtime = st.st_mtime;
+	saved->mtime_nsec = ED_MTIME_NSEC(st);
+	return journaled;
 }
 
-bool ed_cmd_insert(Ed_Address address)
+// Whether the file at `path` still holds the lines of the global context's
+// buffer up to the first one changed since it was loaded or written, setting
+// `start` to the index of that line and `offset` to where it is in the file.
+//
+// Only a file that spares rewriting most of it is worth overwriting in place
+// from there on, since unlike replacing it, a failed write leaves it half
+// written.
+bool ed_context_unchanged(const char *path, size_t *start, size_t *offset)
 {
 	Ed_Context *context = &ed_global_context;
-	if (address.type != ED_ADDRESS_LINE ||
-	    address_out_of_range(address, true)) {
-		ed_return_error(ED_ERROR_INVALID_ADDRESS);
-	}
-
-	Line_Builder lb = { 0 };
-	ssize_t result = lb_read_to_dot(&lb);
-	if (result < 0) {
-		ed_return_error(ED_ERROR_UNKNOWN);
-	}
-
-	context->line = address.position.as_line;
-	ed_context_insert(&lb, line_to_index(context->line));
-	free(lb.items);
+	Ed_Saved *saved = &context->saved;
+	Line_Builder *buffer = &context->buffer;
+
+	struct stat st;
+	*start = saved->dirty < buffer->count ? saved->dirty : buffer->count;
+	if (!saved->valid || *start == 0 || stat(path, &st) != 0 ||
+	    st.st_dev != saved->file.dev || st.st_ino != saved->file.ino ||
+	    (size_t)st.st_size != saved->size || st.st_mtime != saved->mtime ||
+	    ED_MTIME_NSEC(st) != saved->mtime_nsec)
+		return false;
 
-	return true;
+	// the lines before the first change are still where they were loaded
+	// from, so the last of them tells how much of the file to keep
+	size_t len;
+	La_File file;
+	char *last = lb_get(buffer, *start - 1, &len);
+	if (!la_map_offset(last, &file, offset) ||
+	    file.dev != saved->file.dev || file.ino != saved->file.ino)
+		return false;
+	*offset += len;
+	return *offset >= buffer->bytes - *offset;
 }
 
-bool ed_cmd_join(Ed_Address address)
+// Point the lines of the global context's buffer from `start` on at the file
+// at `path` they were just written to from `offset` on, so that the next
+// write can tell what changed since.
+//
+// Returns `false` if the file's journal was left behind by another `ed`.
+bool ed_context_written(const char *path, size_t start, size_t offset)
 {
 	Ed_Context *context = &ed_global_context;
+	Line_Builder *buffer = &context->buffer;
+
+	// reading back what was written to anything but a regular file would
+	// wait for whatever comes next, rather than get the same lines
+	struct stat st;
+	context->saved.valid = false;
+	if (start < buffer->count && stat(path, &st) == 0 &&
+	    S_ISREG(st.st_mode)) {
+		int fd = open(path, O_RDONLY);
+		if (fd < 0)
+			return true;
+		char *data = la_map(fd, offset, buffer->bytes - offset);
+		close(fd);
+		if (data == NULL)
+			return true;
+		lb_point_into(buffer, start, data);
+		la_free(data);
+	}
+	return ed_context_saved(path);
+}
 
-	size_t start, end;
+// Append the lines of the file at `path` to `lb`, pointing them straight into
+// the file where it can be mapped.
+//
+// If `background` is set, the lines of a mapped file are loaded on a thread of
+// their own and handed over to the global context's buffer, which `lb` must
+// be, as they're needed.
+//
+// Returns the amount of bytes read, or -1 after printing why the file couldn't
+// be opened.
+ssize_t ed_read_file(const char *path, Line_Builder *lb, bool background)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		if (!ed_global_context.options.script) {
+			ob_puts(path);
+			ob_puts(": No such file or directory\n");
+		}
+		return -1;
+	}
+
+	// compressed files are streamed through their codec, as there's no
+	// pointing lines into them
+	ssize_t result;
+	const Cz_Codec *codec = cz_detect(fileno(f));
+	if (codec != NULL) {
+		// nothing is read unless the whole file could be, since its
+		// compressed bytes would be ruined if taken for text and
+		// written back
+		Line_Builder lines = { 0 };
+		Cz_Pipe pipe;
+		result = -1;
+		if (cz_decompress(codec, fileno(f), &pipe)) {
+			FILE *decompressed = fdopen(pipe.fd, "r");
+			if (decompressed != NULL) {
+				result = lb_read_file(&lines, decompressed);
+				fclose(decompressed);
+				pipe.fd = -1;
+			}
+			if (!cz_finish(&pipe))
+				result = -1;
+		}
+		fclose(f);
+
+		if (result >= 0) {
+			lb_insert(lb, &lines, lb->count);
+		} else if (!ed_global_context.options.script) {
+			ob_puts(path);
+			ob_puts(": Cannot decompress with ");
+			ob_puts(codec->name);
+			ob_putc('\n');
+		}
+		lb_free(&lines);
+		return result;
+	}
+
+	struct stat st;
+	char *data = NULL;
+	if (fstat(fileno(f), &st) == 0) {
+		// point the lines straight into the file, so that they're only
+		// copied once they're changed...
+		data = la_map(fileno(f), 0, st.st_size);
+		// ...or at least carve all of them out of a single chunk
+		if (data == NULL)
+			la_reserve(st.st_size);
+	}
+
+	if (data != NULL && background && ld_start(data, st.st_size)) {
+		result = st.st_size;
+	} else if (data != NULL) {
+		result = lb_read_mapped(lb, data, st.st_size);
+		la_free(data);
+	} else {
+		result = lb_read_file(lb, f);
+	}
+	fclose(f);
+
+	return result;
+}
+
+bool ed_cmd_edit(char *line)
+{
+	Ed_Context *context = &ed_global_context;
+
+	if (ed_context_warn_unsaved()) {
+		ed_return_error(ED_ERROR_UNSAVED_CHANGES);
+	}
+
+	if (strlen(line) != 0) {
+		free(context->filename);
+		context->filename = strdup(line);
+	}
+
+	if (context->filename == NULL || strlen(context->filename) == 0) {
+		ed_return_error(ED_ERROR_INVALID_COMMAND);
+	}
+
+	// the file replaces the buffer, for good
+	ld_cancel();
+	lb_clear(&context->buffer);
+	ed_context_yank_keep(true);
+	ed_undo_free(&context->undo);
+	// yanked lines outlive the file, which they shouldn't keep mapped
+	lb_detach(&context->yank_register);
+	memset(&context->marks, 0, sizeof(context->marks));
+	context->saved.valid = false;
+	jr_stop();
+	context->line = 0;
+
+	ssize_t result =
+		ed_read_file(context->filename, &context->buffer, true);
+	if (result < 0) {
+		context->change_count++;
+		context->change_id = context->change_count;
+		ed_return_error(ED_ERROR_INVALID_FILE);
+	}
+	context->saved_id = context->change_id;
+
+	// the rest of the file is loaded as it's needed, once the first lines
+	// are there to work on
+	ed_load_until(1);
+	bool journaled = ed_context_saved(context->filename);
+	context->line = ED_LINE_LAST;
+	ed_print_size(result);
+
+	// the file is edited all the same, only without a journal
+	if (!journaled) {
+		ed_return_error(ED_ERROR_JOURNAL_EXISTS);
+	}
+	return true;
+}
+
+bool ed_run_cmd(char *line, bool *quit);
+
+// Delete every marked line of the running global command in one go.
+void ed_global_delete(Ed_Global *global)
+{
+	Ed_Context *context = &ed_global_context;
+
+	size_t count = global->marks.count;
+	size_t last = global->marks.items[count - 1];
+	global->next = count;
+
+	ed_context_pop_many(global->marks.items, count);
+
+	// as with `d`, the last line deleted is what's left in the register
+	ed_context_yank(1);
+
+	// the line after the last one deleted becomes the current one
+	size_t after = last - (count - 1) + 1;
+	context->line = after < context->buffer.count ? after :
+							context->buffer.count;
+}
+
+bool ed_cmd_global(char *line, Ed_Address address, bool matching)
+{
+	Ed_Context *context = &ed_global_context;
+	Ed_Global *global = &context->global;
+
+	if (global->active) {
+		ed_return_error(ED_ERROR_INVALID_COMMAND);
+	}
+
+	if (!address.given) {
+		ed_load_until(SIZE_MAX);
+		address.type = ED_ADDRESS_RANGE;
+		address.position.as_range.start = 1;
+		address.position.as_range.end = context->buffer.count;
+	}
+	if (context->buffer.count == 0 || address_out_of_range(address, false)) {
+		ed_return_error(ED_ERROR_INVALID_ADDRESS);
+	}
+
+	char delimiter = *line;
+	if (delimiter == '\0' || isspace(delimiter)) {
+		ed_return_error(ED_ERROR_INVALID_COMMAND);
+	}
+	line += 1;
+
+	Rx *rx = ed_parse_pattern(&line, delimiter);
+	if (rx == NULL)
+		return false;
+
+	// the command list defaults to printing each line
+	char *commands = trim(line);
+	if (*commands == '\0')
+		commands = "p";
+
+	size_t start, end;
+	if (address.type == ED_ADDRESS_LINE) {
+		start = end = line_to_index(address.position.as_line);
+	} else {
+		start = line_to_index(address.position.as_range.start);
+		end = line_to_index(address.position.as_range.end);
+	}
+
+	// every line is marked up front, so that the command list can't change
+	// which lines it runs on
+	global->marks.count = 0;
+	global->next = 0;
+	global->shift = 0;
+	global->unordered = false;
+	sc_mark(&context->buffer, rx, start, end, matching, &global->marks);
+
+	if (global->marks.count == 0)
+		return true;
+
+	global->active = true;
+
+	// deleting every marked line is done in a single pass
+	if (strcmp(commands, "d") == 0) {
+		ed_global_delete(global);
+		global->active = false;
+		return true;
+	}
+
+	// the command list is parsed in place, so it's copied for every line
+	size_t commands_len = strlen(commands);
+	char *command = malloc(commands_len + 2);
+	assert(command != NULL && "Could not allocate memory");
+
+	bool success = true;
+	while (success && global->next < global->marks.count) {
+		size_t mark = global->marks.items[global->next++];
+		if (mark == ED_GLOBAL_UNMARKED)
+			continue;
+
+		memcpy(command, commands, commands_len);
+		memcpy(command + commands_len, "\n", 2);
+
+		bool quit = false;
+		context->line = mark + global->shift + 1;
+		success = ed_run_cmd(command, &quit);
+	}
+
+	free(command);
+	global->active = false;
+	return success;
+}
+
+bool ed_cmd_insert(Ed_Address address)
+{
+	Ed_Context *context = &ed_global_context;
+	if (address.type != ED_ADDRESS_LINE ||
+	    address_out_of_range(address, true)) {
+		ed_return_error(ED_ERROR_INVALID_ADDRESS);
+	}
+
+	Line_Builder lb = { 0 };
+	ssize_t result = lb_read_to_dot(&lb);
+	if (result < 0) {
+		ed_return_error(ED_ERROR_UNKNOWN);
+	}
+
+	context->line = address.position.as_line;
+	ed_context_insert(&lb, line_to_index(context->line));
+
+	return true;
+}
+
+bool ed_cmd_join(Ed_Address address)
+{
+	Ed_Context *context = &ed_global_context;
+
+	size_t start, end;
 	if (address.type == ED_ADDRESS_LINE) {
 		start = line_to_index(address.position.as_line);
 		end = start + 1;
@@ -534,54 +1461,378 @@ bool ed_cmd_join(Ed_Address address)
 		end = line_to_index(address.position.as_range.end);
 	}
 
+	// a single line is joined with the next one, which may still be loading
+	ed_load_until(end + 1);
 	if ((!lb_contains(context->buffer, start) && start != 0) ||
 	    !lb_contains(context->buffer, end)) {
 		ed_return_error(ED_ERROR_INVALID_ADDRESS);
 	}
 
-	for (size_t i = start + 1; i <= end; ++i) {
-		int len = strlen(context->buffer.items[start]);
-		context->buffer.items[start][len - 1] = '\0';
+	// every line but the last loses its '\n'
+	size_t len = 0;
+	size_t *line_len;
+	Lb_Iter it = lb_iter(&context->buffer, start);
+	for (size_t i = start; i <= end; ++i) {
+		lb_iter_next(&it, &line_len);
+		len += i < end ? *line_len - 1 : *line_len;
+	}
+
+	char *result = la_alloc(len + 1);
+	char *at = result;
+	it = lb_iter(&context->buffer, start);
+	for (size_t i = start; i <= end; ++i) {
+		char *line = *lb_iter_next(&it, &line_len);
+		size_t amount = i < end ? *line_len - 1 : *line_len;
+		memcpy(at, line, amount);
+		at += amount;
+	}
+	*at = '\0';
+
+	Line_Builder lb = { 0 };
+	lb_append(&lb, result, len);
+	ed_context_overwrite(&lb, start, end);
+
+	return true;
+}
+
+// Append `replacement` to `sb`, with `&` standing for the match and `\1`
+// through `\9` for its subexpressions, as found in `line` at `spans`.
+void ed_expand_replacement(String_Builder *sb, const char *replacement,
+			   const char *line, Rx_Span *spans)
+{
+	for (const char *c = replacement; *c != '\0'; c++) {
+		Rx_Span *span = NULL;
+		if (*c == '&') {
+			span = &spans[0];
+		} else if (*c == '\\' && c[1] >= '1' && c[1] <= '9') {
+			span = &spans[*++c - '0'];
+		} else if (*c == '\\' && c[1] != '\0') {
+			c += 1;
+		}
+
+		if (span != NULL) {
+			if (span->end > span->start)
+				da_append_many(sb, line + span->start,
+					       span->end - span->start);
+		} else {
+			da_append(sb, *c);
+		}
+	}
+}
+
+// Substitute matches of `rx` in `line` of length `len` with `replacement`
+// into `sb`, starting from the `nth` match, and going on for every following
+// match if `global`.
+//
+// Returns whether anything was substituted, in which case `sb` holds the whole
+// new line.
+bool ed_substitute_line(String_Builder *sb, Rx *rx, const char *replacement,
+			size_t nth, bool global, const char *line, size_t len)
+{
+	// the '\n' is only put back at the end
+	size_t text_len = len > 0 && line[len - 1] == '\n' ? len - 1 : len;
+
+	Rx_Span spans[RX_SPAN_CAP];
+	size_t from = 0;
+	size_t matches = 0;
+	// an empty match right where the previous match ended doesn't count
+	size_t previous_end = SIZE_MAX;
+	bool changed = false;
+
+	sb->count = 0;
+	while (from <= text_len &&
+	       rx_match(rx, line, text_len, from, spans, RX_SPAN_CAP)) {
+		size_t start = spans[0].start;
+		size_t end = spans[0].end;
+
+		if (start == end && start == previous_end) {
+			if (start < text_len)
+				da_append(sb, line[start]);
+			from = start + 1;
+			continue;
+		}
+
+		matches += 1;
+		if (start > from)
+			da_append_many(sb, line + from, start - from);
+		if (matches == nth || (global && matches > nth)) {
+			ed_expand_replacement(sb, replacement, line, spans);
+			changed = true;
+		} else if (end > start) {
+			da_append_many(sb, line + start, end - start);
+		}
+
+		from = end;
+		previous_end = end;
+		if (start == end) {
+			if (start < text_len)
+				da_append(sb, line[start]);
+			from += 1;
+		}
+
+		if (changed && !global)
+			break;
+	}
+
+	if (changed) {
+		from = from > text_len ? text_len : from;
+		if (len > from)
+			da_append_many(sb, line + from, len - from);
+	}
+	return changed;
+}
+
+bool ed_cmd_read(char *line, Ed_Address address)
+{
+	Ed_Context *context = &ed_global_context;
+
+	if (address_out_of_range(address, true)) {
+		ed_return_error(ED_ERROR_INVALID_ADDRESS);
+	}
+
+	// the file read becomes the default one if there's none yet
+	if (strlen(line) != 0 && context->filename == NULL)
+		context->filename = strdup(line);
+	const char *path = strlen(line) != 0 ? line : context->filename;
+	if (path == NULL) {
+		ed_return_error(ED_ERROR_INVALID_COMMAND);
+	}
+
+	// lines are read after the last one by default
+	if (!address.given) {
+		ed_load_until(SIZE_MAX);
+		address.type = ED_ADDRESS_LINE;
+		address.position.as_line = context->buffer.count;
+	}
+
+	size_t after = address.type == ED_ADDRESS_LINE ?
+			       address.position.as_line :
+			       address.position.as_range.end;
+	Line_Builder *buffer = &context->buffer;
+	size_t count = buffer->count;
+
+	// lines read after the last one go straight into the buffer, and
+	// anywhere else they're only put in place once they're all read
+	ssize_t result;
+	if (after == count) {
+		result = ed_read_file(path, buffer, false);
+		if (buffer->count > count)
+			ed_context_journal(*ed_context_record(
+				count, 0, buffer->count - count));
+	} else {
+		Line_Builder lb = { 0 };
+		result = ed_read_file(path, &lb, false);
+		if (lb.count > 0)
+			ed_context_insert(&lb, after);
+		lb_free(&lb);
+	}
+
+	if (result < 0) {
+		ed_return_error(ED_ERROR_INVALID_FILE);
+	}
+
+	size_t read = buffer->count - count;
+	if (read > 0)
+		context->line = after + read;
+	ed_print_size(result);
+
+	return true;
+}
+
+bool ed_cmd_substitute(char *line, Ed_Address address)
+{
+	Ed_Context *context = &ed_global_context;
+
+	if (address_out_of_range(address, false)) {
+		ed_return_error(ED_ERROR_INVALID_ADDRESS);
+	}
+
+	char delimiter = *line;
+	if (delimiter == '\0' || isspace(delimiter)) {
+		ed_return_error(ED_ERROR_INVALID_COMMAND);
+	}
+	line += 1;
+
+	Rx *rx = ed_parse_pattern(&line, delimiter);
+	if (rx == NULL)
+		return false;
+
+	// only escaped delimiters lose their '\', the rest are kept for
+	// `ed_expand_replacement`
+	char *replacement = line;
+	char *at = line;
+	for (; *line != delimiter && *line != '\n' && *line != '\0'; line++) {
+		if (*line == '\\' && line[1] == delimiter)
+			line += 1;
+		else if (*line == '\\' && line[1] != '\n' && line[1] != '\0')
+			*at++ = *line++;
+		*at++ = *line;
+	}
+
+	// leaving out the closing delimiter prints the result
+	bool print = *line != delimiter;
+	bool global = false;
+	size_t nth = 0;
+	if (*line == delimiter)
+		line += 1;
+	*at = '\0';
+
+	while (*line != '\n' && *line != '\0') {
+		if (*line == 'g' && !global) {
+			global = true;
+			line += 1;
+		} else if (*line == 'p') {
+			print = true;
+			line += 1;
+		} else if (isdigit(*line) && nth == 0) {
+			nth = strtoul(line, &line, 10);
+			if (nth == 0) {
+				ed_return_error(ED_ERROR_INVALID_COMMAND);
+			}
+		} else {
+			ed_return_error(ED_ERROR_INVALID_COMMAND);
+		}
+	}
+	if (nth == 0)
+		nth = 1;
+
+	size_t start, end;
+	if (address.type == ED_ADDRESS_LINE) {
+		start = end = line_to_index(address.position.as_line);
+	} else {
+		start = line_to_index(address.position.as_range.start);
+		end = line_to_index(address.position.as_range.end);
+	}
 
-		char *result = strappend(context->buffer.items[start],
-					 context->buffer.items[i]);
-		free(context->buffer.items[start]);
-		context->buffer.items[start] = result;
+	// lines without a match are left untouched, and the rest are swapped
+	// for their new version right where they are in the tree
+	String_Builder sb = { 0 };
+	size_t last = 0;
+	bool any = false;
+	size_t *len;
+	Lb_Iter it = lb_iter(&context->buffer, start);
+	for (size_t i = start; i <= end; ++i) {
+		char *text = *lb_iter_next(&it, &len);
+		if (!ed_substitute_line(&sb, rx, replacement, nth, global, text,
+					*len))
+			continue;
+
+		ed_context_replace(&it, i, la_dup(sb.items, sb.count),
+				   sb.count);
+		last = i;
+		any = true;
 	}
+	free(sb.items);
 
-	ed_context_pop(start + 1, end);
+	// a `g` or `v` command runs on every marked line, whether or not the
+	// pattern is found on each of them
+	if (!any && context->global.active)
+		return true;
+	if (!any) {
+		ed_return_error(ED_ERROR_NO_MATCH);
+	}
+
+	context->line = last + 1;
+	if (print) {
+		size_t len;
+		char *text = lb_get(&context->buffer, last, &len);
+		ob_write(text, len);
+	}
 
 	return true;
 }
 
+bool ed_cmd_mark(char *line, Ed_Address address)
+{
+	Ed_Context *context = &ed_global_context;
+
+	if (address_out_of_range(address, false)) {
+		ed_return_error(ED_ERROR_INVALID_ADDRESS);
+	}
+
+	char mark = *line;
+	if (!islower(mark) || *trim(line + 1) != '\0') {
+		ed_return_error(ED_ERROR_INVALID_MARK);
+	}
+
+	// a range marks its last line
+	context->marks.lines[mark - 'a'] = address.type == ED_ADDRESS_LINE ?
+						   address.position.as_line :
+						   address.position.as_range.end;
+	return true;
+}
+
 bool ed_cmd_move(char *line, Ed_Address address)
 {
 	Ed_Context *context = &ed_global_context;
 
 	Ed_Address target = ed_parse_address(&line);
+	if (target.type == ED_ADDRESS_INVALID)
+		return false;
 	if (target.type != ED_ADDRESS_LINE ||
 	    address_out_of_range(address, false) ||
 	    address_out_of_range(target, true)) {
 		ed_return_error(ED_ERROR_INVALID_ADDRESS);
 	}
 
-	Line_Builder lb = { 0 };
+	size_t start, end;
 	if (address.type == ED_ADDRESS_LINE) {
-		size_t start = line_to_index(address.position.as_line);
+		start = end = address.position.as_line;
+	} else {
+		start = address.position.as_range.start;
+		end = address.position.as_range.end;
+	}
 
-		lb_append(&lb, strdup(context->buffer.items[start]));
-		ed_context_pop(start, start);
+	// lines can't be moved to after one of themselves, other than the last
+	size_t after = target.position.as_line;
+	if (after >= start && after < end) {
+		ed_return_error(ED_ERROR_INVALID_ADDRESS);
+	}
+
+	// the lines trade places with those between them and the target, so
+	// only the lines in between are touched
+	if (after > end) {
+		ed_context_rotate(start - 1, end, after);
+		context->line = after;
+	} else if (after < start - 1) {
+		ed_context_rotate(after, start - 1, end);
+		context->line = after + end - start + 1;
 	} else {
-		size_t start = line_to_index(address.position.as_range.start);
-		size_t end = address.position.as_range.end;
-		for (size_t i = start; i < end; ++i) {
-			lb_append(&lb, strdup(context->buffer.items[i]));
-		}
+		// lines moved onto themselves stay put, but it's still a change
+		// which can be undone and leaves the buffer modified
+		ed_context_rotate(end, end, end);
+		context->line = end;
+	}
+	return true;
+}
 
-		ed_context_pop(start, end - 1);
+bool ed_cmd_transfer(char *line, Ed_Address address)
+{
+	Ed_Context *context = &ed_global_context;
+
+	Ed_Address target = ed_parse_address(&line);
+	if (target.type == ED_ADDRESS_INVALID)
+		return false;
+	if (target.type != ED_ADDRESS_LINE ||
+	    address_out_of_range(address, false) ||
+	    address_out_of_range(target, true)) {
+		ed_return_error(ED_ERROR_INVALID_ADDRESS);
+	}
+
+	size_t start, end;
+	if (address.type == ED_ADDRESS_LINE) {
+		start = end = line_to_index(address.position.as_line);
+	} else {
+		start = line_to_index(address.position.as_range.start);
+		end = line_to_index(address.position.as_range.end);
 	}
 
+	// the copies share their text with the originals
+	Line_Builder lb = { 0 };
+	lb_copy(&context->buffer, start, end, &lb);
 	ed_context_insert(&lb, target.position.as_line);
+	context->line = target.position.as_line + end - start + 1;
+
 	return true;
 }
 
@@ -595,12 +1846,19 @@ bool ed_cmd_print(Ed_Address address)
 
 	if (address.type == ED_ADDRESS_LINE) {
 		size_t start = line_to_index(address.position.as_line);
-		printf("%s", context->buffer.items[start]);
+		size_t len;
+		char *line = lb_get(&context->buffer, start, &len);
+		ob_write(line, len);
 	} else {
-		lb_print(context->buffer, address.position.as_range.start,
+		lb_print(&context->buffer, address.position.as_range.start,
 			 address.position.as_range.end);
 	}
 
+	// the last line printed becomes the current one
+	context->line = address.type == ED_ADDRESS_LINE ?
+				address.position.as_line :
+				address.position.as_range.end;
+
 	return true;
 }
 
@@ -614,13 +1872,21 @@ bool ed_cmd_print_num(Ed_Address address)
 
 	if (address.type == ED_ADDRESS_LINE) {
 		size_t start = line_to_index(address.position.as_line);
-		printf(PRISize "\t%s", address.position.as_line,
-		       context->buffer.items[start]);
+		size_t len;
+		char *line = lb_get(&context->buffer, start, &len);
+		ob_size(address.position.as_line);
+		ob_putc('\t');
+		ob_write(line, len);
 	} else {
-		lb_printn(context->buffer, address.position.as_range.start,
+		lb_printn(&context->buffer, address.position.as_range.start,
 			  address.position.as_range.end);
 	}
 
+	// the last line printed becomes the current one
+	context->line = address.type == ED_ADDRESS_LINE ?
+				address.position.as_line :
+				address.position.as_range.end;
+
 	return true;
 }
 
@@ -632,30 +1898,126 @@ bool ed_cmd_put(Ed_Address address)
 		ed_return_error(ED_ERROR_INVALID_ADDRESS);
 	}
 
-	Line_Builder tmp = { 0 };
-	lb_foreach(line, context->yank_register)
-	{
-		lb_append(&tmp, strdup(*line));
+	// the undo is replaced by the put, so the register needs lines of its
+	// own by then
+	ed_context_yank_keep(false);
+	size_t count = context->yank_register.count;
+	if (count == 0) {
+		ed_return_error(ED_ERROR_NO_PUT);
 	}
 
-	ed_context_insert(&tmp, address.type == ED_ADDRESS_LINE ?
-					address.position.as_line :
-					address.position.as_range.end);
-	free(tmp.items);
+	// the register keeps its lines for the next put, and shares them
+	Line_Builder tmp = { 0 };
+	lb_copy(&context->yank_register, 0, count - 1, &tmp);
+
+	size_t line = address.type == ED_ADDRESS_LINE ?
+			      address.position.as_line :
+			      address.position.as_range.end;
+	ed_context_insert(&tmp, line);
+	context->line = line + count;
 
 	return true;
 }
 
+// Swap the `amount` lines at `offset` in the lines of `undo` with those at
+// `index` in the global context's buffer, and move the lines taken out of the
+// buffer to `redo`.
+void ed_undo_swap(Ed_Undo *undo, size_t offset, size_t index, size_t amount,
+		  Ed_Undo *redo)
+{
+	Ed_Context *context = &ed_global_context;
+
+	Lb_Iter it = lb_iter(&context->buffer, index);
+	Lb_Iter undo_it = lb_iter(&undo->lines, offset);
+	for (size_t i = 0; i < amount; ++i) {
+		size_t *len, *undo_len;
+		lb_iter_next(&it, &len);
+		char *line = *lb_iter_next(&undo_it, &undo_len);
+
+		size_t old_len;
+		char *old = lb_iter_swap(&context->buffer, &it, line,
+					 *undo_len, &old_len);
+		lb_iter_swap(&undo->lines, &undo_it, old, old_len, &old_len);
+	}
+
+	// the lines being the only ones left is the usual case, as with `s`
+	if (offset == 0 && redo->lines.count == 0) {
+		redo->lines = undo->lines;
+		undo->lines = (Line_Builder){ 0 };
+	} else if (amount > 0) {
+		lb_take(&undo->lines, offset, offset + amount - 1,
+			&redo->lines);
+	}
+}
+
 bool ed_cmd_undo()
 {
 	Ed_Context *context = &ed_global_context;
-	if (context->change_count == context->back_changes) {
+	Ed_Undo *undo = &context->undo;
+	if (undo->steps.count == 0) {
 		ed_return_error(ED_ERROR_NO_UNDO);
 	}
-	lb_swap(&context->buffer, &context->back_buf);
-	size_t tmp = context->change_count;
-	context->change_count = context->back_changes;
-	context->back_changes = tmp;
+
+	// the deleted lines go back into the buffer, while the register keeps
+	// them as well
+	ed_context_yank_keep(false);
+
+	// reverting the steps records their inverse, so that `u` can be undone
+	Ed_Undo redo = { .change_id = context->change_id,
+			 .line = context->line };
+
+	size_t offset = undo->lines.count;
+	for (size_t i = undo->steps.count; i > 0; --i) {
+		Ed_Undo_Step step = undo->steps.items[i - 1];
+
+		Ed_Undo_Step inverse = { .index = step.index,
+					 .removed = step.inserted,
+					 .inserted = step.removed,
+					 .rotated = step.rotated };
+		da_append(&redo.steps, inverse);
+		ed_marks_adjust(&context->marks, inverse, &redo);
+		if (step.index < context->saved.dirty)
+			context->saved.dirty = step.index;
+
+		// moved lines are moved back, with nothing kept in the undo
+		if (step.rotated) {
+			lb_rotate(&context->buffer, step.index,
+				  step.index + step.inserted,
+				  step.index + step.inserted + step.removed);
+			ed_context_journal(inverse);
+			continue;
+		}
+		offset -= step.removed;
+
+		// lines replaced one for one trade places without reshaping
+		// either tree
+		if (step.removed == step.inserted) {
+			ed_undo_swap(undo, offset, step.index, step.removed,
+				     &redo);
+			ed_marks_restore(&context->marks, undo, i, step.index);
+			ed_context_journal(inverse);
+			continue;
+		}
+
+		if (step.inserted > 0) {
+			lb_take(&context->buffer, step.index,
+				step.index + step.inserted - 1, &redo.lines);
+		}
+
+		Line_Builder removed = { 0 };
+		if (step.removed > 0) {
+			lb_take(&undo->lines, offset,
+				offset + step.removed - 1, &removed);
+		}
+		lb_insert(&context->buffer, &removed, step.index);
+		ed_marks_restore(&context->marks, undo, i, step.index);
+		ed_context_journal(inverse);
+	}
+
+	context->change_id = undo->change_id;
+	context->line = undo->line;
+	ed_undo_free(undo);
+	*undo = redo;
 	return true;
 }
 
@@ -672,23 +2034,63 @@ bool ed_cmd_write(char *line)
 		ed_return_error(ED_ERROR_INVALID_COMMAND);
 	}
 
-	FILE *f = fopen(context->filename, "w");
-	if (f == NULL) {
+	// what's unchanged since the file was loaded or written is left as is,
+	// and otherwise the old file is replaced rather than overwritten where
+	// possible, so lines mapped from it stay intact
+	ed_load_until(SIZE_MAX);
+	Line_Builder *buffer = &context->buffer;
+	const char *path = context->filename;
+	const Cz_Codec *codec = cz_for_path(path);
+	size_t start, offset;
+	ssize_t written;
+	if (codec == NULL && ed_context_unchanged(path, &start, &offset)) {
+		// lines pointing into what's about to be overwritten are copied
+		// first, wherever they are
+		La_File file = context->saved.file;
+		lb_privatize(buffer, start, file, offset);
+		lb_privatize(&context->undo.lines, 0, file, offset);
+		lb_privatize(&context->yank_register, 0, file, offset);
+		written = lb_write_over(buffer, path, start, offset,
+					context->options.sync);
+	} else {
+		start = 0;
+		offset = 0;
+
+		// a file that's written into rather than replaced can't have
+		// lines still pointing into it
+		struct stat st;
+		if (!lb_write_replaces(path) && la_maps_file(path) &&
+		    stat(path, &st) == 0) {
+			La_File file = { .dev = st.st_dev, .ino = st.st_ino };
+			lb_privatize(buffer, 0, file, 0);
+			lb_privatize(&context->undo.lines, 0, file, 0);
+			lb_privatize(&context->yank_register, 0, file, 0);
+		}
+		written = lb_write_file(buffer, path, context->options.sync,
+					codec);
+	}
+
+	if (written < 0) {
+		context->saved.valid = false;
 		ed_return_error(ED_ERROR_INVALID_FILE);
 	}
+	// lines can't point into a compressed file
+	bool journaled = codec != NULL ?
+				 ed_context_saved(path) :
+				 ed_context_written(path, start, offset);
 
-	lb_write_to_stream(context->buffer, f);
-	fclose(f);
+	context->saved_id = context->change_id;
+	ed_print_size(written);
 
+	if (!journaled) {
+		ed_return_error(ED_ERROR_JOURNAL_EXISTS);
+	}
 	return true;
 }
 
 bool ed_cmd_quit(bool *quit, bool force)
 {
-	Ed_Context *context = &ed_global_context;
-
-	if (!force && context->change_count > 0) {
-		context->change_count = 0;
+	if (!force && ed_context_warn_unsaved()) {
 		ed_return_error(ED_ERROR_UNSAVED_CHANGES);
 	}
 	*quit = true;
@@ -697,13 +2099,60 @@ bool ed_cmd_quit(bool *quit, bool force)
 
 // API
 
-bool ed_handle_cmd(char *line, bool *quit)
+void ed_init(Ed_Options options)
 {
 	Ed_Context *context = &ed_global_context;
+	context->options = options;
+
+	nl_init();
+	sp_init(options.memory_budget);
+	sc_init(options.threads, options.parallel_lines);
+	if (options.journal)
+		jr_init(options.journal_sync);
+}
+
+// Whether the command `type` works on the current line when given no address.
+bool ed_cmd_takes_line(Ed_Cmd_Type type)
+{
+	switch (type) {
+	case ED_CMD_APPEND:
+	case ED_CMD_CHANGE:
+	case ED_CMD_DELETE:
+	case ED_CMD_INSERT:
+	case ED_CMD_JOIN:
+	case ED_CMD_MARK:
+	case ED_CMD_MOVE:
+	case ED_CMD_PRINT:
+	case ED_CMD_PRINT_NUM:
+	case ED_CMD_PUT:
+	case ED_CMD_SUBSTITUTE:
+	case ED_CMD_TRANSFER:
+	case ED_CMD_INVALID:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Run a single command, as part of the command currently being handled.
+bool ed_run_cmd(char *line, bool *quit)
+{
+	Ed_Context *context = &ed_global_context;
+
+	// whatever was loaded in the meantime is there for the command to use
+	ed_load_until(0);
 
 	Ed_Address address = ed_parse_address(&line);
+	if (address.type == ED_ADDRESS_INVALID)
+		return false;
 
 	Ed_Cmd_Type cmd_type = ed_parse_cmd_type(&line);
+
+	// the current line may be the last one of a file that's still loading,
+	// so it's only looked up for the commands that work on it
+	if (!address.given && ed_cmd_takes_line(cmd_type))
+		address.position.as_line = ed_context_line();
+
 	switch (cmd_type) {
 	case ED_CMD_APPEND: {
 		return ed_cmd_append(address);
@@ -720,6 +2169,12 @@ bool ed_handle_cmd(char *line, bool *quit)
 	case ED_CMD_FORCE_QUIT: {
 		return ed_cmd_quit(quit, true);
 	} break;
+	case ED_CMD_GLOBAL: {
+		return ed_cmd_global(line, address, true);
+	} break;
+	case ED_CMD_GLOBAL_INVERSE: {
+		return ed_cmd_global(line, address, false);
+	} break;
 	case ED_CMD_INSERT: {
 		return ed_cmd_insert(address);
 	} break;
@@ -730,6 +2185,13 @@ bool ed_handle_cmd(char *line, bool *quit)
 		ed_print_error();
 		return true;
 	} break;
+	case ED_CMD_LOAD_PROGRESS: {
+		ed_print_progress();
+		return true;
+	} break;
+	case ED_CMD_MARK: {
+		return ed_cmd_mark(line, address);
+	} break;
 	case ED_CMD_MOVE: {
 		return ed_cmd_move(line, address);
 	} break;
@@ -745,6 +2207,12 @@ bool ed_handle_cmd(char *line, bool *quit)
 	case ED_CMD_QUIT: {
 		return ed_cmd_quit(quit, false);
 	} break;
+	case ED_CMD_READ: {
+		return ed_cmd_read(line, address);
+	} break;
+	case ED_CMD_SUBSTITUTE: {
+		return ed_cmd_substitute(line, address);
+	} break;
 	case ED_CMD_TOGGLE_ERR: {
 		context->should_print_error = !context->should_print_error;
 		return true;
@@ -753,6 +2221,9 @@ bool ed_handle_cmd(char *line, bool *quit)
 		context->prompt = !context->prompt;
 		return true;
 	} break;
+	case ED_CMD_TRANSFER: {
+		return ed_cmd_transfer(line, address);
+	} break;
 	case ED_CMD_UNDO: {
 		return ed_cmd_undo();
 	} break;
@@ -763,9 +2234,7 @@ bool ed_handle_cmd(char *line, bool *quit)
 		// TODO: handle this better
 		if (address.type != ED_ADDRESS_LINE) {
 			ed_return_error(ED_ERROR_INVALID_COMMAND);
-		} else if (!lb_contains(
-				   context->buffer,
-				   line_to_index(address.position.as_line))) {
+		} else if (address_out_of_range(address, false)) {
 			ed_return_error(ED_ERROR_INVALID_ADDRESS);
 		} else {
 			context->line = address.position.as_line;
@@ -776,13 +2245,91 @@ bool ed_handle_cmd(char *line, bool *quit)
 	return true;
 }
 
+bool ed_handle_cmd(char *line, bool *quit)
+{
+	Ed_Context *context = &ed_global_context;
+
+	// changes made by this command start a new undo
+	context->undo.open = false;
+
+	bool result = ed_run_cmd(line, quit);
+	jr_flush();
+	sp_evict();
+	return result;
+}
+
+bool ed_recover(char *path)
+{
+	Ed_Context *context = &ed_global_context;
+
+	// the journal is replayed onto the whole file, as it was when the
+	// journal was started
+	context->filename = strdup(path);
+	ssize_t result = ed_read_file(path, &context->buffer, false);
+	if (result < 0) {
+		ed_return_error(ED_ERROR_INVALID_FILE);
+	}
+	ed_print_size(result);
+
+	struct stat st;
+	ssize_t replayed = -1;
+	if (stat(path, &st) == 0)
+		replayed = jr_recover(path, st.st_size, st.st_mtime,
+				      ED_MTIME_NSEC(st), &context->buffer);
+	// a journal for the file as it was before it changed is deleted, so
+	// that the file can be journaled again
+	if (replayed == JR_STALE) {
+		if (!context->options.script) {
+			ob_puts(path);
+			ob_puts(JR_SUFFIX ": Discarded, the file changed since\n");
+		}
+		ed_return_error(ED_ERROR_STALE_JOURNAL);
+	}
+	if (replayed < 0) {
+		ed_return_error(ED_ERROR_INVALID_JOURNAL);
+	}
+
+	// what was recovered is yet to be written
+	context->change_count += replayed;
+	context->change_id = context->change_count;
+	context->line = context->buffer.count;
+	return true;
+}
+
 void ed_cleanup()
 {
 	Ed_Context *context = &ed_global_context;
 
 	free(context->filename);
-	lb_free(context->buffer);
-	lb_free(context->yank_register);
+	free(context->pattern);
+	free(context->global.marks.items);
+	jr_stop();
+	ld_cancel();
+	sc_release();
+	rx_release();
+
+	// every line is in the arena, so they're freed all at once
+	lb_release(&context->buffer);
+	lb_release(&context->yank_register);
+	lb_release(&context->undo.lines);
+	free(context->undo.steps.items);
+	la_release();
+	sp_release();
+
+	ob_flush();
+}
+
+void ed_print_progress()
+{
+	Ld_Progress progress = ld_progress();
+
+	ob_size(progress.lines);
+	ob_puts(progress.done || progress.size == 0 ? " lines, " :
+						      "+ lines, ");
+	ob_size(progress.bytes);
+	ob_putc('/');
+	ob_size(progress.size);
+	ob_puts(" bytes\n");
 }
 
 bool ed_should_print_error()
@@ -800,32 +2347,60 @@ void ed_print_error()
 	case ED_ERROR_NO_ERROR:
 		break;
 	case ED_ERROR_INVALID_ADDRESS: {
-		printf("Invalid address.\n");
+		ob_puts("Invalid address.\n");
 	} break;
 	case ED_ERROR_INVALID_COMMAND: {
-		printf("Invalid command.\n");
+		ob_puts("Invalid command.\n");
 	} break;
 	case ED_ERROR_INVALID_FILE: {
-		printf("Cannot open input file\n");
+		ob_puts("Cannot open input file\n");
+	} break;
+	case ED_ERROR_INVALID_JOURNAL: {
+		ob_puts("Cannot recover from journal\n");
+	} break;
+	case ED_ERROR_INVALID_MARK: {
+		ob_puts("Invalid mark character.\n");
+	} break;
+	case ED_ERROR_INVALID_PATTERN: {
+		ob_puts("Invalid pattern.\n");
+	} break;
+	case ED_ERROR_JOURNAL_EXISTS: {
+		ob_puts("Journal already exists, recover it with --recover\n");
+	} break;
+	case ED_ERROR_NO_MATCH: {
+		ob_puts("No match.\n");
+	} break;
+	case ED_ERROR_NO_PREVIOUS_PATTERN: {
+		ob_puts("No previous pattern.\n");
+	} break;
+	case ED_ERROR_NO_PUT: {
+		ob_puts("Nothing to put.\n");
 	} break;
 	case ED_ERROR_NO_UNDO: {
-		printf("Nothing to undo.\n");
+		ob_puts("Nothing to undo.\n");
+	} break;
+	case ED_ERROR_STALE_JOURNAL: {
+		ob_puts("Journal doesn't match the file, discarded\n");
 	} break;
 	case ED_ERROR_UNSAVED_CHANGES: {
-		printf("Warning: buffer modified\n");
+		ob_puts("Warning: buffer modified\n");
 	} break;
 	case ED_ERROR_UNKNOWN: {
-		printf("Unknown error.\n");
+		ob_puts("Unknown error.\n");
 	} break;
 	}
 }
 
-ssize_t ed_getline(char **lineptr, size_t *n, FILE *stream)
+ssize_t ed_getline(String_Builder *line)
 {
 	Ed_Context *context = &ed_global_context;
 
 	if (context->prompt)
-		printf("*");
+		ob_putc('*');
+	// whatever was printed so far should be seen before waiting for input,
+	// but input that's already there is run without a write in between
+	if (ib_empty())
+		ob_flush();
 
-	return getline(lineptr, n, stream);
+	return ib_getline(line);
 }
@@ -4,22 +4,56 @@
 #include <stdio.h>
 #include <stdbool.h>
 
+#include "../da.h"
+
+// Options that `ed` can be started with.
+typedef struct {
+	// flush files to disk before they replace the old ones
+	bool sync;
+	// threads to scan for patterns with, or 0 for one per CPU
+	size_t threads;
+	// lines there have to be to scan for a pattern with several threads
+	size_t parallel_lines;
+	// running a script, so byte counts and diagnostics aren't printed
+	bool script;
+	// journal changes next to the file being edited, flushing the journal
+	// to disk once every `journal_sync` changes, or never if 0
+	bool journal;
+	size_t journal_sync;
+	// bytes of lines kept in memory before the rest is spilled to a
+	// scratch file, or 0 for no limit
+	size_t memory_budget;
+} Ed_Options;
+
+// Initialize the global context with `options`.
+void ed_init(Ed_Options options);
+
 // Parse a command from user input.
 //
 // Returns `false` upon failure, `true` upon success.
 // Sets `cmd` to the parsed command.
 bool ed_handle_cmd(char *line, bool *quit);
 
+// Edit the file at `path` with the changes left in its journal replayed.
+//
+// Returns `false` if the file or its journal can't be read, or if the journal
+// was left for the file as it was before it changed, which deletes it.
+bool ed_recover(char *path);
+
 // Clean up the global context.
 void ed_cleanup();
 
+// Print how far loading the file being edited has gotten.
+void ed_print_progress();
+
 // Whether `H` mode is active.
 bool ed_should_print_error();
 
 // Print the last error that occured.
 void ed_print_error();
 
-// Get line after printing prompt.
-ssize_t ed_getline(char **lineptr, size_t *n, FILE *stream);
+// Read the next command into `line` after printing the prompt, reusing its
+// allocation.
+ssize_t ed_getline(String_Builder *line);
 
 #endif // ED_H_
@@ -0,0 +1,81 @@
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./ib.h"
+
+// Struct with the state of the input buffer.
+typedef struct {
+	char items[IB_CAP];
+	// bytes from `start` up to `count` are yet to be read
+	size_t start;
+	size_t count;
+} Ib_Buffer;
+
+// Instance of `Ib_Buffer` that is shared globally.
+static Ib_Buffer ib_global_buffer = { .items = { 0 }, .start = 0, .count = 0 };
+
+// Refill the input buffer from STDIN, returning `false` at EOF.
+static bool ib_fill(void)
+{
+	Ib_Buffer *ib = &ib_global_buffer;
+
+	ssize_t nread = read(STDIN_FILENO, ib->items, IB_CAP);
+	ib->start = 0;
+	ib->count = nread > 0 ? nread : 0;
+	return nread > 0;
+}
+
+ssize_t ib_getline(String_Builder *line)
+{
+	Ib_Buffer *ib = &ib_global_buffer;
+
+	line->count = 0;
+	while (true) {
+		if (ib_empty() && !ib_fill()) {
+			if (line->count == 0)
+				return -1;
+			break;
+		}
+
+		char *start = ib->items + ib->start;
+		size_t left = ib->count - ib->start;
+		char *newline = memchr(start, '\n', left);
+		size_t len = newline == NULL ? left :
+						 (size_t)(newline + 1 - start);
+
+		da_append_many(line, start, len);
+		ib->start += len;
+		if (newline != NULL)
+			break;
+	}
+
+	sb_append_nul(line);
+	line->count -= 1;
+	return line->count;
+}
+
+char *ib_peek(size_t *size)
+{
+	Ib_Buffer *ib = &ib_global_buffer;
+
+	if (ib_empty() && !ib_fill())
+		return NULL;
+
+	*size = ib->count - ib->start;
+	return ib->items + ib->start;
+}
+
+void ib_consume(size_t size)
+{
+	Ib_Buffer *ib = &ib_global_buffer;
+
+	assert(size <= ib->count - ib->start);
+	ib->start += size;
+}
+
+bool ib_empty(void)
+{
+	Ib_Buffer *ib = &ib_global_buffer;
+	return ib->start == ib->count;
+}
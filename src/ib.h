@@ -0,0 +1,35 @@
+#ifndef IB_H_
+#define IB_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "../da.h"
+
+// Everything read from STDIN goes through the input buffer, which is filled
+// a large block at a time rather than a line at a time.
+
+// Size of the input buffer.
+#define IB_CAP (1 << 20)
+
+// Read the next line from STDIN into `line`, replacing what it held and
+// nul-terminating it, so that a single allocation serves every line.
+//
+// Returns the length of the line, including its '\n', or -1 at EOF.
+ssize_t ib_getline(String_Builder *line);
+
+// Return the bytes of STDIN that are buffered but not read yet, refilling the
+// input buffer first if it's used up, and set `size` to how many there are.
+//
+// Returns `NULL` at EOF.
+char *ib_peek(size_t *size);
+
+// Mark the first `size` bytes returned by `ib_peek` as read.
+void ib_consume(size_t size);
+
+// Whether the input buffer is used up, so that reading on would wait for
+// STDIN.
+bool ib_empty(void);
+
+#endif // IB_H_
@@ -0,0 +1,371 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef _WIN32
+#include <io.h>
+#endif // _WIN32
+
+#include "../da.h"
+#include "./jr.h"
+#include "./la.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif // O_BINARY
+
+// the journal is kept from the programs compressing and decompressing files
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif // O_CLOEXEC
+
+// Struct with the state of the journal.
+typedef struct {
+	bool enabled;
+	size_t sync_every;
+	// journal being written to, or -1 if there's none
+	int fd;
+	char *path;
+	// records not written out yet, and how many of them there are
+	String_Builder pending;
+	size_t records;
+	// records written out since the journal was last flushed to disk
+	size_t unsynced;
+} Jr_Journal;
+
+// Instance of `Jr_Journal` that is shared globally.
+static Jr_Journal jr_global_journal = { .enabled = false,
+					.sync_every = 0,
+					.fd = -1,
+					.path = NULL,
+					.pending = { 0 },
+					.records = 0,
+					.unsynced = 0 };
+
+void jr_init(size_t sync_every)
+{
+	Jr_Journal *jr = &jr_global_journal;
+	jr->enabled = true;
+	jr->sync_every = sync_every;
+}
+
+// Path of the journal of the file at `path`.
+static char *jr_path(const char *path)
+{
+	size_t len = strlen(path);
+	char *journal = malloc(len + sizeof(JR_SUFFIX));
+	assert(journal != NULL && "Could not allocate memory");
+	memcpy(journal, path, len);
+	memcpy(journal + len, JR_SUFFIX, sizeof(JR_SUFFIX));
+	return journal;
+}
+
+// Append `n` to the records not written out yet.
+static void jr_put(size_t n)
+{
+	String_Builder *pending = &jr_global_journal.pending;
+
+	while (n >= 0x80) {
+		da_append(pending, (char)((n & 0x7f) | 0x80));
+		n >>= 7;
+	}
+	da_append(pending, (char)n);
+}
+
+// Read a number stored at `*at`, before `end`, moving `*at` past it.
+//
+// Returns `false` if it's cut off.
+static bool jr_get(const char **at, const char *end, size_t *n)
+{
+	*n = 0;
+	for (unsigned shift = 0; *at < end && shift < 64; shift += 7) {
+		unsigned char byte = *(*at)++;
+		*n |= (size_t)(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+// Write out the records not written out yet, giving up on the journal if
+// they can't be.
+static void jr_write_pending(void)
+{
+	Jr_Journal *jr = &jr_global_journal;
+
+	const char *data = jr->pending.items;
+	size_t size = jr->pending.count;
+	while (size > 0) {
+		ssize_t written = write(jr->fd, data, size);
+		if (written < 0) {
+			// what made it into the journal is kept, since it
+			// can still be recovered
+			close(jr->fd);
+			jr->fd = -1;
+			break;
+		}
+		data += written;
+		size -= written;
+	}
+	jr->pending.count = 0;
+}
+
+// Read the header of the journal at `*at`, before `end`, moving `*at` past it.
+//
+// Returns `false` if it's cut off or isn't for the file which is `size` bytes
+// long and was last modified `mtime_nsec` nanoseconds into the second `mtime`.
+static bool jr_header(const char **at, const char *end, size_t size,
+		      time_t mtime, long mtime_nsec)
+{
+	size_t magic = strlen(JR_MAGIC);
+	if ((size_t)(end - *at) < magic || memcmp(*at, JR_MAGIC, magic) != 0)
+		return false;
+	*at += magic;
+
+	size_t journal_size, journal_mtime, journal_mtime_nsec;
+	return jr_get(at, end, &journal_size) &&
+	       jr_get(at, end, &journal_mtime) &&
+	       jr_get(at, end, &journal_mtime_nsec) && journal_size == size &&
+	       journal_mtime == (size_t)mtime &&
+	       journal_mtime_nsec == (size_t)mtime_nsec;
+}
+
+// Whether the journal at `journal` can't be recovered onto the file it's
+// next to, as described by `size`, `mtime` and `mtime_nsec`.
+//
+// A journal which can't be read is left alone.
+static bool jr_stale(const char *journal, size_t size, time_t mtime,
+		     long mtime_nsec)
+{
+	int fd = open(journal, O_RDONLY | O_BINARY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	// the header is the magic and three numbers of at most 10 bytes each
+	char header[64];
+	ssize_t nread = read(fd, header, sizeof(header));
+	close(fd);
+	if (nread < 0)
+		return false;
+
+	const char *at = header;
+	return !jr_header(&at, header + nread, size, mtime, mtime_nsec);
+}
+
+Jr_Start jr_start(const char *path, size_t size, time_t mtime,
+		  long mtime_nsec)
+{
+	Jr_Journal *jr = &jr_global_journal;
+	if (!jr->enabled)
+		return JR_STARTED;
+
+	// the journal started before is deleted first, so that any journal
+	// still there is one which may have to be recovered
+	jr_stop();
+	jr->path = jr_path(path);
+	int flags = O_WRONLY | O_CREAT | O_EXCL | O_BINARY | O_CLOEXEC;
+	jr->fd = open(jr->path, flags, 0600);
+
+	// a journal for the file as it was before it changed can't ever be
+	// recovered, so it only stands in the way
+	bool discarded = false;
+	if (jr->fd < 0 && errno == EEXIST &&
+	    jr_stale(jr->path, size, mtime, mtime_nsec) &&
+	    unlink(jr->path) == 0) {
+		discarded = true;
+		jr->fd = open(jr->path, flags, 0600);
+	}
+
+	if (jr->fd < 0) {
+		bool exists = errno == EEXIST;
+		free(jr->path);
+		jr->path = NULL;
+		return exists ? JR_KEPT : discarded ? JR_DISCARDED : JR_STARTED;
+	}
+
+	// the header is flushed like a record, so that the records after it
+	// are never on disk without it
+	da_append_many(&jr->pending, JR_MAGIC, strlen(JR_MAGIC));
+	jr_put(size);
+	jr_put((size_t)mtime);
+	jr_put((size_t)mtime_nsec);
+	jr->records += 1;
+	jr_flush();
+	return discarded ? JR_DISCARDED : JR_STARTED;
+}
+
+void jr_change(size_t index, size_t removed, Line_Builder *lb,
+	       size_t inserted)
+{
+	Jr_Journal *jr = &jr_global_journal;
+	if (jr->fd < 0)
+		return;
+
+	da_append(&jr->pending, JR_CHANGE);
+	jr_put(index);
+	jr_put(removed);
+	jr_put(inserted);
+	jr->records += 1;
+	if (inserted == 0)
+		return;
+
+	size_t *len;
+	Lb_Iter it = lb_iter(lb, index);
+	for (size_t i = 0; i < inserted; ++i) {
+		char *line = *lb_iter_next(&it, &len);
+		jr_put(*len);
+		da_append_many(&jr->pending, line, *len);
+
+		// a large change is written out as it goes, rather than
+		// gathered in full
+		if (jr->pending.count >= JR_PENDING_MAX) {
+			jr_write_pending();
+			if (jr->fd < 0)
+				return;
+		}
+	}
+}
+
+void jr_move(size_t first, size_t middle, size_t last)
+{
+	Jr_Journal *jr = &jr_global_journal;
+	if (jr->fd < 0)
+		return;
+
+	da_append(&jr->pending, JR_MOVE);
+	jr_put(first);
+	jr_put(middle);
+	jr_put(last);
+	jr->records += 1;
+}
+
+void jr_flush(void)
+{
+	Jr_Journal *jr = &jr_global_journal;
+	if (jr->fd < 0 || jr->records == 0)
+		return;
+
+	jr_write_pending();
+	jr->unsynced += jr->records;
+	jr->records = 0;
+	if (jr->fd < 0 || jr->sync_every == 0 ||
+	    jr->unsynced < jr->sync_every)
+		return;
+
+#ifdef _WIN32
+	_commit(jr->fd);
+#else
+	fsync(jr->fd);
+#endif // _WIN32
+	jr->unsynced = 0;
+}
+
+void jr_stop(void)
+{
+	Jr_Journal *jr = &jr_global_journal;
+
+	if (jr->fd >= 0)
+		close(jr->fd);
+	if (jr->path != NULL)
+		unlink(jr->path);
+
+	free(jr->path);
+	jr->path = NULL;
+	jr->fd = -1;
+	jr->pending.count = 0;
+	jr->records = 0;
+	jr->unsynced = 0;
+}
+
+ssize_t jr_recover(const char *path, size_t size, time_t mtime,
+		   long mtime_nsec, Line_Builder *lb)
+{
+	Jr_Journal *jr = &jr_global_journal;
+
+	ssize_t replayed = -1;
+	String_Builder data = { 0 };
+	Line_Builder inserted = { 0 };
+	char *journal = jr_path(path);
+	int fd = open(journal, O_RDWR | O_BINARY | O_CLOEXEC);
+	if (fd < 0)
+		goto defer;
+
+	// the journal only holds changes, so it's read in whole
+	char block[1 << 16];
+	ssize_t nread;
+	while ((nread = read(fd, block, sizeof(block))) > 0)
+		da_append_many(&data, block, nread);
+	if (nread < 0)
+		goto defer;
+
+	// a journal which doesn't match the file is of no use to anyone, and
+	// would keep the file from being journaled again
+	const char *at = data.items;
+	const char *end = data.items + data.count;
+	if (!jr_header(&at, end, size, mtime, mtime_nsec)) {
+		unlink(journal);
+		replayed = JR_STALE;
+		goto defer;
+	}
+
+	replayed = 0;
+	const char *replayed_end = at;
+	while (at < end) {
+		char type = *at++;
+		size_t a, b, c;
+		if (!jr_get(&at, end, &a) || !jr_get(&at, end, &b) ||
+		    !jr_get(&at, end, &c))
+			break;
+
+		if (type == JR_MOVE) {
+			if (a > b || b > c || c > lb->count)
+				break;
+			lb_rotate(lb, a, b, c);
+		} else if (type == JR_CHANGE) {
+			if (a > lb->count || b > lb->count - a)
+				break;
+
+			size_t len;
+			while (inserted.count < c && jr_get(&at, end, &len) &&
+			       len <= (size_t)(end - at)) {
+				lb_append(&inserted, la_dup(at, len), len);
+				at += len;
+			}
+			if (inserted.count < c)
+				break;
+
+			if (b > 0)
+				lb_pop(lb, a, a + b - 1);
+			lb_insert(lb, &inserted, a);
+		} else {
+			break;
+		}
+
+		replayed_end = at;
+		replayed += 1;
+	}
+
+	// whatever couldn't be replayed is dropped, so that journaling goes on
+	// right after what was
+	if (jr->enabled &&
+	    ftruncate(fd, replayed_end - data.items) == 0 &&
+	    lseek(fd, 0, SEEK_END) >= 0) {
+		jr_stop();
+		jr->fd = fd;
+		jr->path = journal;
+		fd = -1;
+		journal = NULL;
+	}
+
+defer:
+	if (fd >= 0)
+		close(fd);
+	lb_free(&inserted);
+	free(data.items);
+	free(journal);
+	return replayed;
+}
@@ -0,0 +1,98 @@
+#ifndef JR_H_
+#define JR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "./lb.h"
+
+// Journaling of the changes made to the buffer since it was loaded from or
+// last written to its file, into a file next to it, so that they can be
+// recovered if `ed` dies before writing them.
+//
+// The journal starts with `JR_MAGIC` and the size and modification time of
+// the file it applies to, in seconds and then nanoseconds, followed by a
+// record for each change:
+//
+// - `JR_CHANGE`, the index of the first line changed, the amount of lines
+//   removed there and the amount inserted in their place, followed by the
+//   length and bytes of each line inserted.
+// - `JR_MOVE`, the `first`, `middle` and `last` indices of a rotation, as
+//   with `lb_rotate`.
+//
+// Every number is stored 7 bits at a time, lowest first, with the top bit of
+// each byte set while there are more to come.
+
+// Bytes the journal starts with.
+#define JR_MAGIC "EDJ2"
+
+// What the journal of a file is named after it.
+#define JR_SUFFIX ".journal"
+
+// Types of records.
+#define JR_CHANGE 'c'
+#define JR_MOVE 'm'
+
+// Amount of bytes of records gathered before they're written out, even if
+// the command making them isn't done.
+#define JR_PENDING_MAX (1 << 20)
+
+// Result of `jr_recover` for a journal which doesn't match its file.
+#define JR_STALE -2
+
+// Enable journaling, flushing the journal to disk once every `sync_every`
+// records written, or leaving that to the system if 0.
+void jr_init(size_t sync_every);
+
+// Outcomes of `jr_start`.
+typedef enum {
+	// the file is journaled, or there's nothing to journal it into
+	JR_STARTED = 0,
+	// the file already has a journal which wasn't started by this process,
+	// likely left behind by a crash, which is kept for `--recover` rather
+	// than overwritten, and nothing is journaled
+	JR_KEPT,
+	// the file had a journal left behind for it as it was before it
+	// changed, which can't be recovered and was replaced
+	JR_DISCARDED,
+} Jr_Start;
+
+// Start journaling the changes made to the file at `path`, which is `size`
+// bytes long and was last modified `mtime_nsec` nanoseconds into the second
+// `mtime`, replacing the journal started before.
+//
+// Does nothing unless journaling was enabled.
+Jr_Start jr_start(const char *path, size_t size, time_t mtime,
+		  long mtime_nsec);
+
+// Journal that `removed` lines at `index` were replaced by the `inserted`
+// lines of `lb` now there.
+void jr_change(size_t index, size_t removed, Line_Builder *lb,
+	       size_t inserted);
+
+// Journal that the lines from `first` up to `middle` traded places with
+// those from `middle` up to `last`.
+void jr_move(size_t first, size_t middle, size_t last);
+
+// Write out the records journaled so far.
+void jr_flush(void);
+
+// Stop journaling, deleting the journal.
+void jr_stop(void);
+
+// Replay the journal of the file at `path`, which is `size` bytes long and
+// was last modified `mtime_nsec` nanoseconds into the second `mtime`, onto
+// `lb`, which holds the file's lines, then keep journaling into it if
+// journaling was enabled.
+//
+// A record cut off by the end of the journal is dropped, along with anything
+// after a record that doesn't fit `lb`.
+//
+// Returns the amount of records replayed, -1 if there's no journal for the
+// file, or `JR_STALE` if its journal was left for the file as it was before
+// it changed, in which case the journal is deleted.
+ssize_t jr_recover(const char *path, size_t size, time_t mtime,
+		   long mtime_nsec, Line_Builder *lb);
+
+#endif // JR_H_
@@ -0,0 +1,335 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include "../da.h"
+#include "./la.h"
+#include "./sp.h"
+
+// Every line is preceded by a header, which remembers how much room it has,
+// so that the room can be reused once the line is freed, and how many owners
+// share it.
+typedef struct {
+	// room of the line, in multiples of `LA_ALIGN`
+	uint32_t cap;
+	// amount of owners the line has besides the first one
+	uint32_t refs;
+} La_Header;
+
+// Lines are aligned to the size of a header, which also makes room for
+// the pointer linking a freed line to the next one on its free list.
+#define LA_ALIGN sizeof(La_Header)
+
+// Default size of a chunk.
+#define LA_CHUNK_SIZE (1 << 20)
+
+// Lines with up to this much room each have a free list for their exact size,
+// while bigger lines share a free list for every power of two.
+#define LA_SMALL 256
+#define LA_LARGE_CLASS(log2) (LA_SMALL / LA_ALIGN + 1 + (log2)-8)
+#define LA_CLASS_COUNT LA_LARGE_CLASS(64)
+
+// A block of memory lines are carved out of.
+typedef struct La_Chunk La_Chunk;
+struct La_Chunk {
+	La_Chunk *prev;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+// A part of a file which was mapped into memory, from `offset` on.
+typedef struct {
+	char *data;
+	size_t size;
+	size_t offset;
+	La_File file;
+	// amount of lines pointing into the mapping, plus one for whoever
+	// mapped it until they're done with it
+	size_t refs;
+} La_Map;
+
+// Struct with the global state of the line allocator.
+typedef struct {
+	// chunk lines are currently carved out of, linked to the previous ones
+	La_Chunk *chunk;
+	// heads of the free lists of each size class
+	char *free[LA_CLASS_COUNT];
+	da(La_Map) maps;
+} La_Arena;
+
+// Instance of `La_Arena` that is shared globally.
+static La_Arena la_global_arena = { .chunk = NULL,
+				    .free = { 0 },
+				    .maps = { 0 } };
+
+// The mapped file `line` points into, or `NULL` if it was allocated.
+static La_Map *la_find_map(const char *line)
+{
+	La_Arena *arena = &la_global_arena;
+
+	da_foreach(map, arena->maps)
+	{
+		if (line >= map->data && line < map->data + map->size)
+			return map;
+	}
+	return NULL;
+}
+
+// Floor of the base 2 logarithm of `n`.
+static size_t la_log2(size_t n)
+{
+	return sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(n);
+}
+
+// Size class of a freed line with `cap` room.
+static size_t la_class(size_t cap)
+{
+	if (cap <= LA_SMALL)
+		return cap / LA_ALIGN;
+	return LA_LARGE_CLASS(la_log2(cap));
+}
+
+// Take a freed line with at least `cap` room off the free lists.
+static char *la_pop_free(size_t cap)
+{
+	La_Arena *arena = &la_global_arena;
+
+	size_t class = la_class(cap);
+	// every line of the next class is big enough, but the head of this one
+	// may still fit
+	char *line = arena->free[class];
+	if (line == NULL || ((La_Header *)line - 1)->cap * LA_ALIGN < cap) {
+		if (cap <= LA_SMALL || class + 1 >= LA_CLASS_COUNT)
+			return NULL;
+		class += 1;
+		line = arena->free[class];
+		if (line == NULL)
+			return NULL;
+	}
+
+	memcpy(&arena->free[class], line, sizeof(char *));
+	return line;
+}
+
+// Allocate a new chunk with room for `size` bytes.
+static La_Chunk *la_chunk_new(size_t size)
+{
+	La_Chunk *chunk = sp_alloc(sizeof(*chunk) + size);
+	chunk->prev = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+char *la_alloc(size_t size)
+{
+	La_Arena *arena = &la_global_arena;
+
+	size_t cap = (size + LA_ALIGN - 1) / LA_ALIGN * LA_ALIGN;
+	if (cap == 0)
+		cap = LA_ALIGN;
+
+	char *line = la_pop_free(cap);
+	if (line != NULL) {
+		((La_Header *)line - 1)->refs = 0;
+		return line;
+	}
+
+	size_t need = sizeof(La_Header) + cap;
+	La_Chunk *chunk = arena->chunk;
+	if (chunk == NULL || chunk->size - chunk->used < need) {
+		if (need > LA_CHUNK_SIZE / 2 && chunk != NULL) {
+			// huge lines get a chunk of their own, which is kept behind
+			// the current one so that its leftover room isn't wasted
+			La_Chunk *own = la_chunk_new(need);
+			own->prev = chunk->prev;
+			chunk->prev = own;
+			chunk = own;
+		} else {
+			chunk = la_chunk_new(need > LA_CHUNK_SIZE ? need :
+								    LA_CHUNK_SIZE);
+			chunk->prev = arena->chunk;
+			arena->chunk = chunk;
+		}
+	}
+
+	La_Header *header = (La_Header *)(chunk->data + chunk->used);
+	assert(cap / LA_ALIGN <= UINT32_MAX && "Line is too long");
+	header->cap = cap / LA_ALIGN;
+	header->refs = 0;
+	chunk->used += need;
+	return (char *)(header + 1);
+}
+
+char *la_dup(const char *line, size_t len)
+{
+	char *copy = la_alloc(len + 1);
+	memcpy(copy, line, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+// Unmap `map`, which nothing points into anymore.
+static void la_unmap(La_Map *map)
+{
+	La_Arena *arena = &la_global_arena;
+
+#ifndef _WIN32
+	munmap(map->data, map->size);
+#endif // _WIN32
+	*map = arena->maps.items[arena->maps.count - 1];
+	arena->maps.count -= 1;
+}
+
+void la_free(char *line)
+{
+	La_Arena *arena = &la_global_arena;
+
+	if (line == NULL)
+		return;
+
+	// a mapping is only unmapped once every line pointing into it is gone
+	La_Map *map = la_find_map(line);
+	if (map != NULL) {
+		map->refs -= 1;
+		if (map->refs == 0)
+			la_unmap(map);
+		return;
+	}
+
+	// the room is only reused once every owner is done with it
+	La_Header *header = (La_Header *)line - 1;
+	if (header->refs > 0) {
+		header->refs -= 1;
+		return;
+	}
+
+	size_t class = la_class(header->cap * LA_ALIGN);
+	memcpy(line, &arena->free[class], sizeof(char *));
+	arena->free[class] = line;
+}
+
+char *la_share(char *line)
+{
+	La_Map *map = la_find_map(line);
+	if (map != NULL) {
+		map->refs += 1;
+		return line;
+	}
+
+	La_Header *header = (La_Header *)line - 1;
+	assert(header->refs < UINT32_MAX && "Line is shared too many times");
+	header->refs += 1;
+	return line;
+}
+
+void la_reserve(size_t size)
+{
+	La_Arena *arena = &la_global_arena;
+
+	La_Chunk *chunk = arena->chunk;
+	if (chunk != NULL && chunk->size - chunk->used >= size)
+		return;
+
+	chunk = la_chunk_new(size > LA_CHUNK_SIZE ? size : LA_CHUNK_SIZE);
+	chunk->prev = arena->chunk;
+	arena->chunk = chunk;
+}
+
+char *la_map(int fd, size_t offset, size_t size)
+{
+#ifdef _WIN32
+	(void)fd;
+	(void)offset;
+	(void)size;
+	return NULL;
+#else
+	La_Arena *arena = &la_global_arena;
+
+	struct stat st;
+	if (size == 0 || fstat(fd, &st) != 0)
+		return NULL;
+
+	// mappings start on a page, so the bytes before `offset` on its page
+	// are mapped as well
+	size_t skip = offset % (size_t)sysconf(_SC_PAGESIZE);
+	char *data = mmap(NULL, skip + size, PROT_READ, MAP_PRIVATE, fd,
+			  offset - skip);
+	if (data == MAP_FAILED)
+		return NULL;
+	madvise(data, skip + size, MADV_SEQUENTIAL);
+
+	La_Map map = { .data = data,
+		       .size = skip + size,
+		       .offset = offset - skip,
+		       .file = { .dev = st.st_dev, .ino = st.st_ino },
+		       .refs = 1 };
+	da_append(&arena->maps, map);
+	return data + skip;
+#endif // _WIN32
+}
+
+void la_hold(const char *data, size_t count)
+{
+	La_Map *map = la_find_map(data);
+	assert(map != NULL && "Only mapped files are held");
+	map->refs += count;
+}
+
+bool la_mapped(const char *line)
+{
+	return la_find_map(line) != NULL;
+}
+
+bool la_map_offset(const char *line, La_File *file, size_t *offset)
+{
+	La_Map *map = la_find_map(line);
+	if (map == NULL)
+		return false;
+
+	*file = map->file;
+	*offset = map->offset + (line - map->data);
+	return true;
+}
+
+bool la_maps_file(const char *path)
+{
+	La_Arena *arena = &la_global_arena;
+
+	struct stat st;
+	if (arena->maps.count == 0 || stat(path, &st) != 0)
+		return false;
+
+	da_foreach(map, arena->maps)
+	{
+		if (map->file.dev == st.st_dev && map->file.ino == st.st_ino)
+			return true;
+	}
+	return false;
+}
+
+void la_release(void)
+{
+	La_Arena *arena = &la_global_arena;
+
+	while (arena->maps.count > 0)
+		la_unmap(&arena->maps.items[0]);
+	free(arena->maps.items);
+
+	La_Chunk *chunk = arena->chunk;
+	while (chunk != NULL) {
+		La_Chunk *prev = chunk->prev;
+		sp_free(chunk, sizeof(*chunk) + chunk->size);
+		chunk = prev;
+	}
+
+	memset(arena, 0, sizeof(*arena));
+}
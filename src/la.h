@@ -0,0 +1,70 @@
+#ifndef LA_H_
+#define LA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Allocate room for a line of `size` bytes (including the '\0').
+//
+// Lines are carved out of large chunks, reusing the room of freed lines where
+// possible, so the result must be freed with `la_free` and never `free`.
+char *la_alloc(size_t size);
+
+// Copy the `len` bytes of `line` into a new allocation.
+//
+// The copy is nul-terminated, though it may also hold '\0's of its own.
+char *la_dup(const char *line, size_t len);
+
+// Put `line` back on a free list, so that its room can be reused.
+//
+// Lines shared with `la_share` only lose an owner, and lines which point into
+// a mapped file have the file unmapped once the last of them is freed.
+void la_free(char *line);
+
+// Give `line` another owner, returning it.
+//
+// Lines are never written to once allocated, so owners can share them freely,
+// and the line is only freed once every owner has called `la_free` on it.
+char *la_share(char *line);
+
+// Identity of a file, which stays the same for as long as the file exists.
+typedef struct {
+	dev_t dev;
+	ino_t ino;
+} La_File;
+
+// Map `size` bytes of the file `fd` from `offset` on into memory, so that
+// lines can point straight into it rather than being copied.
+//
+// The mapping starts out held by the caller alone, until they call `la_free`
+// on what's returned, and lines pointing into it must be given owners with
+// `la_hold` or `la_share` so that it stays mapped as long as they're around.
+//
+// Returns where the byte at `offset` was mapped, or `NULL` if the file can't
+// be mapped.
+char *la_map(int fd, size_t offset, size_t size);
+
+// Give the mapped file `data` points into `count` more owners, one for each
+// line just pointed into it.
+void la_hold(const char *data, size_t count);
+
+// Whether `line` points into a mapped file, and so can't be written to.
+bool la_mapped(const char *line);
+
+// Whether `line` points into a mapped file, setting `file` to that file and
+// `offset` to where in the file the line is.
+bool la_map_offset(const char *line, La_File *file, size_t *offset);
+
+// Whether the file at `path` is currently mapped.
+bool la_maps_file(const char *path);
+
+// Make sure `size` bytes can be allocated without starting another chunk,
+// so that loading a file of a known size carves all of its lines out of
+// one chunk.
+void la_reserve(size_t size);
+
+// Free every line ever allocated and unmap every mapped file, all at once.
+void la_release(void);
+
+#endif // LA_H_
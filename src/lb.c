@@ -1,75 +1,756 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif // _WIN32
+
 #include "./lb.h"
+#include "./ib.h"
+#include "./la.h"
+#include "./nl.h"
+#include "./ob.h"
+#include "./sp.h"
 
-ssize_t lb_read_from_stream(Line_Builder *lb, FILE *file, char *condition)
+ssize_t lb_read_to_dot(Line_Builder *lb)
 {
-	ssize_t bits_read = 0;
+	uint32_t *ends = malloc(NL_BLOCK_SIZE * sizeof(*ends));
+	assert(ends != NULL && "Could not allocate memory");
+
+	// lines are carved straight out of the input buffer, other than one
+	// cut off by its end, which is put together here
+	String_Builder partial = { 0 };
+	ssize_t bytes_read = 0;
+	bool done = false;
+	while (!done) {
+		size_t size;
+		char *data = ib_peek(&size);
+		if (data == NULL)
+			break;
+		if (size > NL_BLOCK_SIZE)
+			size = NL_BLOCK_SIZE;
+		la_reserve(size);
+
+		size_t start = 0;
+		size_t count = nl_index(data, size, ends);
+		for (size_t i = 0; i < count && !done; ++i) {
+			size_t end = ends[i] + 1;
+			char *line = data + start;
+			size_t len = end - start;
+			if (partial.count > 0) {
+				da_append_many(&partial, line, len);
+				line = partial.items;
+				len = partial.count;
+				partial.count = 0;
+			}
+
+			bytes_read += len;
+			start = end;
+			if (len == 2 && line[0] == '.')
+				done = true;
+			else
+				lb_append(lb, la_dup(line, len), len);
+		}
+
+		if (!done && start < size)
+			da_append_many(&partial, data + start, size - start);
+		ib_consume(done ? start : size);
+	}
+
+	// input that ends without a "." still counts, as a last line
+	if (partial.count > 0) {
+		bytes_read += partial.count;
+		lb_append(lb, la_dup(partial.items, partial.count),
+			  partial.count);
+	}
+	free(partial.items);
+	free(ends);
+
+	return bytes_read;
+}
+
+ssize_t lb_read_file(Line_Builder *lb, FILE *file)
+{
+	// a line cut off by the end of a block is carried over to the start of
+	// the next one, which grows if the line doesn't fit in it
+	size_t cap = NL_BLOCK_SIZE;
+	char *block = malloc(cap);
+	uint32_t *ends = malloc(NL_BLOCK_SIZE * sizeof(*ends));
+	assert(block != NULL && ends != NULL && "Could not allocate memory");
+
+	ssize_t bytes_read = 0;
+	size_t kept = 0;
 	while (true) {
-		char *line = NULL;
-		size_t nsize = 0;
-		ssize_t nread = getline(&line, &nsize, file);
+		if (kept == cap) {
+			cap *= 2;
+			block = realloc(block, cap);
+			assert(block != NULL && "Could not allocate memory");
+		}
+
+		size_t nread = fread(block + kept, 1, cap - kept, file);
+		if (nread == 0)
+			break;
+		bytes_read += nread;
 
-		if (nread > 0) {
-			bits_read += nread;
+		// only the new bytes are scanned, as the kept ones hold no '\n'
+		size_t size = kept + nread;
+		size_t start = 0;
+		for (size_t offset = kept; offset < size;
+		     offset += NL_BLOCK_SIZE) {
+			size_t scanned = size - offset < NL_BLOCK_SIZE ?
+						 size - offset :
+						 NL_BLOCK_SIZE;
+			size_t count = nl_index(block + offset, scanned, ends);
+			for (size_t i = 0; i < count; ++i) {
+				size_t end = offset + ends[i] + 1;
+				lb_append(lb, la_dup(block + start, end - start),
+					  end - start);
+				start = end;
+			}
 		}
-		if (nread < 1) {
-			if (line != NULL)
-				free(line);
-			return bits_read;
+
+		kept = size - start;
+		memmove(block, block + start, kept);
+	}
+
+	if (kept > 0)
+		lb_append(lb, la_dup(block, kept), kept);
+	free(ends);
+	free(block);
+
+	return ferror(file) ? -1 : bytes_read;
+}
+
+ssize_t lb_read_mapped(Line_Builder *lb, char *data, size_t size)
+{
+	size_t count_before = lb->count;
+	uint32_t *ends = malloc(NL_BLOCK_SIZE * sizeof(*ends));
+	assert(ends != NULL && "Could not allocate memory");
+
+	char *line = data;
+	for (size_t offset = 0; offset < size; offset += NL_BLOCK_SIZE) {
+		size_t scanned = size - offset < NL_BLOCK_SIZE ?
+					 size - offset :
+					 NL_BLOCK_SIZE;
+		size_t count = nl_index(data + offset, scanned, ends);
+		for (size_t i = 0; i < count; ++i) {
+			char *end = data + offset + ends[i] + 1;
+			lb_append(lb, line, end - line);
+			line = end;
 		}
+	}
+
+	if (line < data + size)
+		lb_append(lb, line, data + size - line);
+	free(ends);
+	la_hold(data, lb->count - count_before);
+
+	return size;
+}
+
+// NODES
+
+// Allocate an empty node.
+static Lb_Node *lb_node_new(void)
+{
+	return sp_alloc(sizeof(Lb_Node));
+}
+
+// Free `node` and everything under it, including the lines unless they're
+// going to be released along with the arena.
+static void lb_node_free(Lb_Node *node, size_t height, bool lines)
+{
+	for (size_t i = 0; i < node->length; ++i) {
+		if (height > 0)
+			lb_node_free(node->children[i], height - 1, lines);
+		else if (lines)
+			la_free(node->lines[i]);
+	}
+	sp_free(node, sizeof(*node));
+}
+
+// Amount of lines under `node`.
+static size_t lb_node_count(Lb_Node *node, size_t height)
+{
+	if (height == 0)
+		return node->length;
+
+	size_t count = 0;
+	for (size_t i = 0; i < node->length; ++i)
+		count += node->counts[i];
+	return count;
+}
+
+// Copy `amount` entries of `src` starting at `from` into `dst` at `at`,
+// returning the amount of lines under the copied entries.
+//
+// `src` and `dst` may be the same node.
+static size_t lb_node_copy(Lb_Node *dst, size_t at, Lb_Node *src, size_t from,
+			   size_t amount, size_t height)
+{
+	if (height == 0) {
+		memmove(dst->lines + at, src->lines + from,
+			amount * sizeof(*src->lines));
+		memmove(dst->lens + at, src->lens + from,
+			amount * sizeof(*src->lens));
+		return amount;
+	}
+
+	size_t count = 0;
+	for (size_t i = 0; i < amount; ++i)
+		count += src->counts[from + i];
+
+	memmove(dst->counts + at, src->counts + from,
+		amount * sizeof(*src->counts));
+	memmove(dst->children + at, src->children + from,
+		amount * sizeof(*src->children));
+	return count;
+}
+
+// Move the upper half of the full `node` into a new sibling, returning it.
+static Lb_Node *lb_node_split(Lb_Node *node, size_t height)
+{
+	Lb_Node *sibling = lb_node_new();
+	size_t half = node->length / 2;
+
+	lb_node_copy(sibling, 0, node, half, node->length - half, height);
+	sibling->length = node->length - half;
+	node->length = half;
+
+	if (height == 0) {
+		sibling->next = node->next;
+		node->next = sibling;
+	}
+
+	return sibling;
+}
+
+// Insert `line` of length `len` at `index` under `node`.
+//
+// Returns a new sibling holding the upper half of `node` if it had to be
+// split to make room, or `NULL` otherwise.
+static Lb_Node *lb_node_insert(Lb_Node *node, size_t height, size_t index,
+			       char *line, size_t len)
+{
+	if (height == 0) {
+		Lb_Node *sibling = NULL;
+		if (node->length == LB_LEAF_CAP) {
+			sibling = lb_node_split(node, height);
+			if (index > node->length) {
+				index -= node->length;
+				node = sibling;
+			}
+		}
+
+		lb_node_copy(node, index + 1, node, index, node->length - index,
+			     height);
+		node->lines[index] = line;
+		node->lens[index] = len;
+		node->length += 1;
+		return sibling;
+	}
+
+	// inserting at the end of a child is preferred over the start of the next,
+	// so that appending always goes to the last leaf
+	size_t i = 0;
+	while (i + 1 < node->length && index > node->counts[i]) {
+		index -= node->counts[i];
+		i += 1;
+	}
+
+	node->counts[i] += 1;
+	Lb_Node *split = lb_node_insert(node->children[i], height - 1, index,
+					line, len);
+	if (split == NULL)
+		return NULL;
+
+	size_t moved = lb_node_count(split, height - 1);
+	node->counts[i] -= moved;
+
+	Lb_Node *sibling = NULL;
+	if (node->length == LB_NODE_CAP) {
+		sibling = lb_node_split(node, height);
+		if (i >= node->length) {
+			i -= node->length;
+			node = sibling;
+		}
+	}
+
+	lb_node_copy(node, i + 2, node, i + 1, node->length - i - 1, height);
+	node->counts[i + 1] = moved;
+	node->children[i + 1] = split;
+	node->length += 1;
+	return sibling;
+}
+
+// Append `line` of length `len` under `node`, the last node of its level.
+//
+// Returns a new sibling holding the line if `node` was full, or `NULL`
+// otherwise. Unlike with `lb_node_insert`, full nodes are left as they are,
+// since nothing is going to go in before the line.
+static Lb_Node *lb_node_append(Lb_Node *node, size_t height, char *line,
+			       size_t len)
+{
+	if (height == 0) {
+		Lb_Node *sibling = NULL;
+		if (node->length == LB_LEAF_CAP) {
+			sibling = lb_node_new();
+			node->next = sibling;
+			node = sibling;
+		}
+
+		node->lines[node->length] = line;
+		node->lens[node->length] = len;
+		node->length += 1;
+		return sibling;
+	}
 
-		if (strcmp(line, condition) == 0) {
-			free(line);
-			return bits_read;
+	size_t i = node->length - 1;
+	Lb_Node *split = lb_node_append(node->children[i], height - 1, line,
+					len);
+	if (split == NULL) {
+		node->counts[i] += 1;
+		return NULL;
+	}
+
+	Lb_Node *sibling = NULL;
+	if (node->length == LB_NODE_CAP) {
+		sibling = lb_node_new();
+		node = sibling;
+	}
+
+	node->counts[node->length] = 1;
+	node->children[node->length] = split;
+	node->length += 1;
+	return sibling;
+}
+
+// Merge or redistribute the `i`th child of `node` with a neighbour,
+// after it has become less than half full.
+static void lb_node_rebalance(Lb_Node *node, size_t height, size_t i)
+{
+	if (node->length < 2)
+		return;
+
+	size_t left = i + 1 < node->length ? i : i - 1;
+	size_t right = left + 1;
+	Lb_Node *a = node->children[left];
+	Lb_Node *b = node->children[right];
+	size_t cap = height == 1 ? LB_LEAF_CAP : LB_NODE_CAP;
+
+	if (a->length + b->length <= cap) {
+		lb_node_copy(a, a->length, b, 0, b->length, height - 1);
+		a->length += b->length;
+		if (height == 1)
+			a->next = b->next;
+		sp_free(b, sizeof(*b));
+
+		node->counts[left] += node->counts[right];
+		lb_node_copy(node, right, node, right + 1,
+			     node->length - right - 1, height);
+		node->length -= 1;
+		return;
+	}
+
+	size_t half = (a->length + b->length) / 2;
+	size_t moved;
+	if (a->length < half) {
+		size_t amount = half - a->length;
+		moved = lb_node_copy(a, a->length, b, 0, amount, height - 1);
+		lb_node_copy(b, 0, b, amount, b->length - amount, height - 1);
+		a->length += amount;
+		b->length -= amount;
+		node->counts[left] += moved;
+		node->counts[right] -= moved;
+	} else {
+		size_t amount = a->length - half;
+		lb_node_copy(b, amount, b, 0, b->length, height - 1);
+		moved = lb_node_copy(b, 0, a, half, amount, height - 1);
+		a->length -= amount;
+		b->length += amount;
+		node->counts[left] -= moved;
+		node->counts[right] += moved;
+	}
+}
+
+// Remove the line at `index` under `node`, returning it and setting `len` to
+// its length.
+static char *lb_node_remove(Lb_Node *node, size_t height, size_t index,
+			    size_t *len)
+{
+	if (height == 0) {
+		char *line = node->lines[index];
+		*len = node->lens[index];
+		lb_node_copy(node, index, node, index + 1,
+			     node->length - index - 1, height);
+		node->length -= 1;
+		return line;
+	}
+
+	size_t i = 0;
+	while (index >= node->counts[i]) {
+		index -= node->counts[i];
+		i += 1;
+	}
+
+	Lb_Node *child = node->children[i];
+	char *line = lb_node_remove(child, height - 1, index, len);
+	node->counts[i] -= 1;
+
+	size_t cap = height == 1 ? LB_LEAF_CAP : LB_NODE_CAP;
+	if (child->length < cap / 2)
+		lb_node_rebalance(node, height, i);
+
+	return line;
+}
+
+// LINE BUILDER
+
+// Insert a single line of length `len` into `lb` at `index`.
+static void lb_insert_line(Line_Builder *lb, size_t index, char *line,
+			   size_t len)
+{
+	assert(index <= lb->count);
+
+	if (lb->root == NULL) {
+		lb->root = lb_node_new();
+		lb->height = 0;
+	}
+
+	Lb_Node *split =
+		index == lb->count ?
+			lb_node_append(lb->root, lb->height, line, len) :
+			lb_node_insert(lb->root, lb->height, index, line, len);
+	if (split != NULL) {
+		Lb_Node *root = lb_node_new();
+		root->length = 2;
+		root->children[0] = lb->root;
+		root->children[1] = split;
+		root->counts[1] = lb_node_count(split, lb->height);
+		root->counts[0] = lb->count + 1 - root->counts[1];
+		lb->root = root;
+		lb->height += 1;
+	}
+
+	lb->count += 1;
+	lb->bytes += len;
+}
+
+// Remove the line at `index` from `lb`, returning it and setting `len` to its
+// length.
+static char *lb_remove_line(Line_Builder *lb, size_t index, size_t *len)
+{
+	assert(index < lb->count);
+
+	char *line = lb_node_remove(lb->root, lb->height, index, len);
+	lb->count -= 1;
+	lb->bytes -= *len;
+
+	// shrink the tree once the root is left with a single child
+	while (lb->height > 0 && lb->root->length == 1) {
+		Lb_Node *root = lb->root;
+		lb->root = root->children[0];
+		lb->height -= 1;
+		sp_free(root, sizeof(*root));
+	}
+
+	if (lb->count == 0) {
+		sp_free(lb->root, sizeof(*lb->root));
+		lb->root = NULL;
+	}
+
+	return line;
+}
+
+char *lb_get(Line_Builder *lb, size_t index, size_t *len)
+{
+	assert(index < lb->count);
+
+	Lb_Node *node = lb->root;
+	for (size_t height = lb->height; height > 0; --height) {
+		size_t i = 0;
+		while (index >= node->counts[i]) {
+			index -= node->counts[i];
+			i += 1;
 		}
+		node = node->children[i];
+	}
+
+	*len = node->lens[index];
+	return node->lines[index];
+}
+
+void lb_append(Line_Builder *lb, char *line, size_t len)
+{
+	lb_insert_line(lb, lb->count, line, len);
+}
+
+// Append every line of `source` to `out`, leaving `source`'s lines to `out`.
+static void lb_append_all(Line_Builder *out, Line_Builder *source)
+{
+	lb_foreach(line, len, *source)
+	{
+		lb_append(out, *line, *len);
+	}
+}
 
-		lb_append(lb, line);
+// Hang `child`, which holds `count` lines and is `height` levels tall, off
+// the right edge of `node`, which is `node_height` levels tall.
+//
+// Returns a new sibling holding the upper half of `node` if it had to be
+// split to make room, or `NULL` otherwise.
+static Lb_Node *lb_node_attach(Lb_Node *node, size_t node_height,
+			       Lb_Node *child, size_t height, size_t count)
+{
+	size_t i = node->length - 1;
+	Lb_Node *split = child;
+	size_t moved = count;
+
+	if (node_height > height + 1) {
+		node->counts[i] += count;
+		split = lb_node_attach(node->children[i], node_height - 1,
+				       child, height, count);
+		if (split == NULL)
+			return NULL;
+
+		moved = lb_node_count(split, node_height - 1);
+		node->counts[i] -= moved;
+	}
+
+	Lb_Node *sibling = NULL;
+	if (node->length == LB_NODE_CAP) {
+		sibling = lb_node_split(node, node_height);
+		node = sibling;
+	}
+
+	node->counts[node->length] = moved;
+	node->children[node->length] = split;
+	node->length += 1;
+	return sibling;
+}
+
+// Hang `child`, which holds `count` lines and is `height` levels tall, off
+// the left edge of `node`, which is `node_height` levels tall.
+//
+// Returns a new sibling holding the upper half of `node` if it had to be
+// split to make room, or `NULL` otherwise.
+static Lb_Node *lb_node_prepend(Lb_Node *node, size_t node_height,
+				Lb_Node *child, size_t height, size_t count)
+{
+	size_t at = 0;
+	Lb_Node *split = child;
+	size_t moved = count;
+
+	if (node_height > height + 1) {
+		node->counts[0] += count;
+		split = lb_node_prepend(node->children[0], node_height - 1,
+					child, height, count);
+		if (split == NULL)
+			return NULL;
+
+		moved = lb_node_count(split, node_height - 1);
+		node->counts[0] -= moved;
+		at = 1;
 	}
+
+	// the split always leaves the front of `node` where it was
+	Lb_Node *sibling = NULL;
+	if (node->length == LB_NODE_CAP)
+		sibling = lb_node_split(node, node_height);
+
+	lb_node_copy(node, at + 1, node, at, node->length - at, node_height);
+	node->counts[at] = moved;
+	node->children[at] = split;
+	node->length += 1;
+	return sibling;
+}
+
+// Move the lines of `source` to the end of `target`, by hanging the shorter
+// of their trees off the edge of the taller one.
+static void lb_concat(Line_Builder *target, Line_Builder *source)
+{
+	assert(target->count > 0 && source->count > 0);
+
+	// the leaves of both trees are linked up first
+	Lb_Node *last = target->root;
+	for (size_t height = target->height; height > 0; --height)
+		last = last->children[last->length - 1];
+	Lb_Node *first = source->root;
+	for (size_t height = source->height; height > 0; --height)
+		first = first->children[0];
+	last->next = first;
+
+	Line_Builder joined = { .count = target->count + source->count,
+				.bytes = target->bytes + source->bytes };
+	Lb_Node *left = target->root;
+	Lb_Node *right = source->root;
+	if (target->height > source->height) {
+		joined.root = target->root;
+		joined.height = target->height;
+		right = lb_node_attach(target->root, target->height,
+				       source->root, source->height,
+				       source->count);
+	} else if (target->height < source->height) {
+		joined.root = source->root;
+		joined.height = source->height;
+		left = source->root;
+		right = lb_node_prepend(source->root, source->height,
+					target->root, target->height,
+					target->count);
+	} else {
+		joined.height = target->height;
+	}
+
+	if (right != NULL) {
+		Lb_Node *root = lb_node_new();
+		root->length = 2;
+		root->children[0] = left;
+		root->children[1] = right;
+		root->counts[1] = lb_node_count(right, joined.height);
+		root->counts[0] = joined.count - root->counts[1];
+		joined.root = root;
+		joined.height += 1;
+	}
+
+	*target = joined;
+	*source = (Line_Builder){ 0 };
 }
 
 void lb_insert(Line_Builder *target, Line_Builder *source, size_t index)
 {
 	assert(index <= target->count);
 
-	realloc_chunk(target, source->count);
+	// an empty target can take over the whole tree
+	if (target->count == 0) {
+		lb_release(target);
+		*target = *source;
+		*source = (Line_Builder){ 0 };
+		return;
+	}
 
-	memmove(target->items + index + source->count, target->items + index,
-		(target->count - index) * sizeof(*target->items));
-	target->count += source->count;
+	// a tree's worth of lines goes after the last line in a single splice,
+	// where there are few enough to go in place one at a time
+	if (index == target->count && source->count >= LB_LEAF_CAP &&
+	    target->count >= LB_LEAF_CAP) {
+		lb_concat(target, source);
+		return;
+	}
 
-	memcpy(target->items + index, source->items,
-	       source->count * sizeof(source->items));
+	// inserting more lines than there are is cheaper done by building a new
+	// tree in a single pass
+	if (source->count > target->count) {
+		Line_Builder joined = { 0 };
+		size_t i = 0;
+		lb_foreach(line, len, *target)
+		{
+			if (i++ == index)
+				lb_append_all(&joined, source);
+			lb_append(&joined, *line, *len);
+		}
+		if (index == target->count)
+			lb_append_all(&joined, source);
+
+		lb_release(target);
+		lb_release(source);
+		*target = joined;
+		*source = (Line_Builder){ 0 };
+		return;
+	}
+
+	lb_foreach(line, len, *source)
+	{
+		lb_insert_line(target, index++, *line, *len);
+		*line = NULL;
+	}
+
+	lb_clear(source);
 }
 
-void lb_overwrite(Line_Builder *target, Line_Builder *source, size_t start,
-		  size_t end)
+void lb_pop(Line_Builder *target, size_t start, size_t end)
+{
+	assert(end < target->count);
+
+	size_t len;
+	for (size_t i = start; i <= end; ++i)
+		la_free(lb_remove_line(target, start, &len));
+}
+
+void lb_take(Line_Builder *target, size_t start, size_t end, Line_Builder *out)
 {
 	assert(end < target->count);
 
 	size_t amount = end + 1 - start;
 
-	realloc_chunk(target, source->count + amount);
+	// taking every line into an empty builder hands the whole tree over
+	if (amount == target->count && out->count == 0) {
+		lb_release(out);
+		*out = *target;
+		*target = (Line_Builder){ 0 };
+		return;
+	}
 
-	for (size_t i = start; i <= end; ++i)
-		free(target->items[i]);
+	// taking most of the lines is cheaper done by putting the rest in a new
+	// tree in a single pass
+	if (amount > target->count / 2) {
+		Line_Builder kept = { 0 };
+		size_t i = 0;
+		lb_foreach(line, len, *target)
+		{
+			bool taken = i >= start && i <= end;
+			lb_append(taken ? out : &kept, *line, *len);
+			i += 1;
+		}
 
-	memmove(target->items + start + source->count, target->items + end + 1,
-		(target->count - end - 1) * sizeof(*target->items));
-	target->count += source->count - amount;
+		lb_release(target);
+		*target = kept;
+		return;
+	}
 
-	memcpy(target->items + start, source->items,
-	       source->count * sizeof(*source->items)); // maybe no *?
+	size_t len;
+	for (size_t i = start; i <= end; ++i) {
+		char *line = lb_remove_line(target, start, &len);
+		lb_append(out, line, len);
+	}
 }
 
-void lb_pop(Line_Builder *target, size_t start, size_t end)
+void lb_take_many(Line_Builder *target, const size_t *indices, size_t count,
+		  Line_Builder *out)
 {
-	assert(end < target->count);
+	// the lines that are left are put in a new tree in a single pass, where
+	// taking lines out one by one would rebalance the tree every time
+	Line_Builder kept = { 0 };
+	size_t next = 0;
+	size_t index = 0;
+	lb_foreach(line, len, *target)
+	{
+		if (next < count && indices[next] == index) {
+			lb_append(out, *line, *len);
+			next += 1;
+		} else {
+			lb_append(&kept, *line, *len);
+		}
+		index += 1;
+	}
+	assert(next == count);
 
-	for (size_t i = start; i <= end; ++i)
-		free(target->items[i]);
+	lb_release(target);
+	*target = kept;
+}
 
-	memmove(target->items + start, target->items + end + 1,
-		(target->count - end - 1) * sizeof(*target->items));
-	target->count -= end - start + 1;
+void lb_copy(Line_Builder *source, size_t start, size_t end,
+	     Line_Builder *out)
+{
+	assert(end < source->count);
+
+	size_t *len;
+	Lb_Iter it = lb_iter(source, start);
+	for (size_t i = start; i <= end; ++i) {
+		char *line = *lb_iter_next(&it, &len);
+		lb_append(out, la_share(line), *len);
+	}
 }
 
 bool lb_contains(Line_Builder lb, size_t n)
@@ -77,26 +758,473 @@ bool lb_contains(Line_Builder lb, size_t n)
 	return n < lb.count;
 }
 
-void lb_clone(Line_Builder *a, Line_Builder *b)
+void lb_free(Line_Builder *lb)
 {
-	lb_clear(*b);
-	lb_foreach(line, *a)
-	{
-		lb_append(b, strdup(*line));
+	if (lb->root != NULL)
+		lb_node_free(lb->root, lb->height, true);
+}
+
+void lb_release(Line_Builder *lb)
+{
+	if (lb->root != NULL)
+		lb_node_free(lb->root, lb->height, false);
+}
+
+void lb_clear(Line_Builder *lb)
+{
+	lb_free(lb);
+	lb->root = NULL;
+	lb->height = 0;
+	lb->count = 0;
+	lb->bytes = 0;
+}
+
+Lb_Iter lb_iter(Line_Builder *lb, size_t index)
+{
+	Lb_Iter it = { 0 };
+	if (index >= lb->count)
+		return it;
+
+	Lb_Node *node = lb->root;
+	for (size_t height = lb->height; height > 0; --height) {
+		size_t i = 0;
+		while (index >= node->counts[i]) {
+			index -= node->counts[i];
+			i += 1;
+		}
+		node = node->children[i];
 	}
+
+	it.leaf = node;
+	it.slot = index;
+	return it;
+}
+
+char **lb_iter_next(Lb_Iter *it, size_t **len)
+{
+	while (it->leaf != NULL && it->slot >= it->leaf->length) {
+		it->leaf = it->leaf->next;
+		it->slot = 0;
+	}
+
+	if (it->leaf == NULL)
+		return NULL;
+
+	*len = &it->leaf->lens[it->slot];
+	return &it->leaf->lines[it->slot++];
 }
 
-void lb_swap(Line_Builder *a, Line_Builder *b)
+char *lb_iter_swap(Line_Builder *lb, Lb_Iter *it, char *line, size_t len,
+		   size_t *old_len)
 {
-	char **temp_items = b->items;
-	size_t temp_count = b->count;
-	size_t temp_cap = b->capacity;
+	assert(it->leaf != NULL && it->slot > 0);
 
-	b->items = a->items;
-	b->count = a->count;
-	b->capacity = a->capacity;
+	size_t slot = it->slot - 1;
+	char *old = it->leaf->lines[slot];
+	*old_len = it->leaf->lens[slot];
+
+	it->leaf->lines[slot] = line;
+	it->leaf->lens[slot] = len;
+	lb->bytes = lb->bytes - *old_len + len;
+	return old;
+}
+
+void lb_rotate(Line_Builder *lb, size_t first, size_t middle, size_t last)
+{
+	assert(first <= middle && middle <= last && last <= lb->count);
+	if (first == middle || middle == last)
+		return;
+
+	// the shorter side is set aside, and the longer one shifted over in a
+	// single pass, so that each line is moved once
+	size_t leading = middle - first;
+	size_t trailing = last - middle;
+	size_t saved = leading < trailing ? leading : trailing;
+	size_t longer = leading < trailing ? trailing : leading;
+
+	// a few lines moving far are cheaper to take out and put back in, at
+	// the cost of reshaping the tree, than to shift everything between
+	if (saved < longer / LB_LEAF_CAP) {
+		Line_Builder moved = { 0 };
+		if (leading <= trailing) {
+			lb_take(lb, first, middle - 1, &moved);
+			lb_insert(lb, &moved, last - saved);
+		} else {
+			lb_take(lb, middle, last - 1, &moved);
+			lb_insert(lb, &moved, first);
+		}
+		lb_release(&moved);
+		return;
+	}
+
+	char **lines = malloc(saved * sizeof(*lines));
+	size_t *lens = malloc(saved * sizeof(*lens));
+	assert(lines != NULL && lens != NULL && "Could not allocate memory");
+
+	size_t *len = NULL;
+	char **line;
+	Lb_Iter write = lb_iter(lb, first);
+	if (leading <= trailing) {
+		// the lines after the leading ones move up to take their place,
+		// and the leading ones go after them
+		Lb_Iter read = lb_iter(lb, first);
+		for (size_t i = 0; i < saved; ++i) {
+			line = lb_iter_next(&read, &len);
+			lines[i] = *line;
+			lens[i] = *len;
+		}
+		for (size_t i = 0; i < trailing; ++i) {
+			size_t *write_len = NULL;
+			char **write_line = lb_iter_next(&write, &write_len);
+			line = lb_iter_next(&read, &len);
+			assert(write_line != NULL && line != NULL);
+			*write_line = *line;
+			*write_len = *len;
+		}
+		for (size_t i = 0; i < saved; ++i) {
+			line = lb_iter_next(&write, &len);
+			assert(line != NULL);
+			*line = lines[i];
+			*len = lens[i];
+		}
+	} else {
+		// the trailing lines go first, and every line after them is
+		// the one `saved` lines before it, held back in a ring until
+		// its place comes up
+		Lb_Iter read = lb_iter(lb, middle);
+		for (size_t i = 0; i < saved; ++i) {
+			line = lb_iter_next(&read, &len);
+			lines[i] = *line;
+			lens[i] = *len;
+		}
+		size_t ring = 0;
+		for (size_t i = first; i < last; ++i) {
+			line = lb_iter_next(&write, &len);
+			assert(line != NULL);
+			char *held = *line;
+			size_t held_len = *len;
+			*line = lines[ring];
+			*len = lens[ring];
+			lines[ring] = held;
+			lens[ring] = held_len;
+			ring = ring + 1 == saved ? 0 : ring + 1;
+		}
+	}
+
+	free(lines);
+	free(lens);
+}
 
-	a->items = temp_items;
-	a->count = temp_count;
-	a->capacity = temp_cap;
+void lb_privatize(Line_Builder *lb, size_t start, La_File file, size_t offset)
+{
+	if (start >= lb->count)
+		return;
+
+	size_t *len;
+	char **line;
+	Lb_Iter it = lb_iter(lb, start);
+	while ((line = lb_iter_next(&it, &len)) != NULL) {
+		La_File line_file;
+		size_t line_offset;
+		if (la_map_offset(*line, &line_file, &line_offset) &&
+		    line_file.dev == file.dev && line_file.ino == file.ino &&
+		    line_offset + *len > offset) {
+			char *copy = la_dup(*line, *len);
+			la_free(*line);
+			*line = copy;
+		}
+	}
+}
+
+void lb_detach(Line_Builder *lb)
+{
+	size_t *len;
+	char **line;
+	Lb_Iter it = lb_iter(lb, 0);
+	while ((line = lb_iter_next(&it, &len)) != NULL) {
+		if (la_mapped(*line)) {
+			char *copy = la_dup(*line, *len);
+			la_free(*line);
+			*line = copy;
+		}
+	}
+}
+
+void lb_point_into(Line_Builder *lb, size_t start, char *data)
+{
+	if (start >= lb->count)
+		return;
+
+	size_t *len;
+	char **line;
+	la_hold(data, lb->count - start);
+	Lb_Iter it = lb_iter(lb, start);
+	while ((line = lb_iter_next(&it, &len)) != NULL) {
+		la_free(*line);
+		*line = data;
+		data += *len;
+	}
+}
+
+#ifndef _WIN32
+// Write out the `count` buffers of `iov` in full, retrying after partial
+// writes.
+static bool lb_writev_all(int fd, struct iovec *iov, size_t count)
+{
+	while (count > 0) {
+		ssize_t written = writev(fd, iov, count);
+		if (written < 0)
+			return false;
+
+		while (count > 0 && (size_t)written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov += 1;
+			count -= 1;
+		}
+		if (count > 0) {
+			iov->iov_base = (char *)iov->iov_base + written;
+			iov->iov_len -= written;
+		}
+	}
+	return true;
+}
+#endif // _WIN32
+
+// Write the lines of `lb` from `start` on into the file descriptor `fd`.
+//
+// Returns the amount of bytes written, or -1 upon failure.
+static ssize_t lb_write_from(Line_Builder *lb, size_t start, int fd)
+{
+	if (start >= lb->count)
+		return 0;
+
+	size_t *len;
+	char **line;
+	size_t written = 0;
+	Lb_Iter it = lb_iter(lb, start);
+#ifdef _WIN32
+	while ((line = lb_iter_next(&it, &len)) != NULL) {
+		if (write(fd, *line, *len) != (ssize_t)*len)
+			return -1;
+		written += *len;
+	}
+#else
+	// lines are handed over straight from the tree, a batch at a time
+	struct iovec iov[LB_WRITE_BATCH];
+	size_t count = 0;
+
+	while ((line = lb_iter_next(&it, &len)) != NULL) {
+		iov[count].iov_base = *line;
+		iov[count].iov_len = *len;
+		written += *len;
+		if (++count == LB_WRITE_BATCH) {
+			if (!lb_writev_all(fd, iov, count))
+				return -1;
+			count = 0;
+		}
+	}
+	if (!lb_writev_all(fd, iov, count))
+		return -1;
+#endif // _WIN32
+
+	return written;
+}
+
+ssize_t lb_write_to_fd(Line_Builder *lb, int fd)
+{
+	return lb_write_from(lb, 0, fd);
+}
+
+#ifndef _WIN32
+// Path of the file that writing to `path` ends up in, following symlinks
+// rather than replacing them.
+static char *lb_write_target(const char *path)
+{
+	char *target = realpath(path, NULL);
+	if (target == NULL)
+		target = strdup(path);
+	assert(target != NULL && "Could not allocate memory");
+	return target;
+}
+
+// Whether the file at `target` can be replaced with a new one without losing
+// anything it is: it's a regular file with no other links, owned by the user,
+// in a directory they can write to, or it doesn't exist yet.
+static bool lb_replaceable(const char *target)
+{
+	struct stat st;
+	if (stat(target, &st) != 0)
+		return errno == ENOENT;
+	if (!S_ISREG(st.st_mode) || st.st_nlink != 1 ||
+	    st.st_uid != geteuid())
+		return false;
+
+	const char *slash = strrchr(target, '/');
+	if (slash == NULL)
+		return access(".", W_OK) == 0;
+	if (slash == target)
+		return access("/", W_OK) == 0;
+
+	char *dir = strndup(target, slash - target);
+	assert(dir != NULL && "Could not allocate memory");
+	bool writable = access(dir, W_OK) == 0;
+	free(dir);
+	return writable;
+}
+#endif // _WIN32
+
+bool lb_write_replaces(const char *path)
+{
+#ifdef _WIN32
+	(void)path;
+	return false;
+#else
+	char *target = lb_write_target(path);
+	bool replaces = lb_replaceable(target);
+	free(target);
+	return replaces;
+#endif // _WIN32
+}
+
+ssize_t lb_write_file(Line_Builder *lb, const char *path, bool sync,
+		      const Cz_Codec *codec)
+{
+#ifdef _WIN32
+	// there's no replacing a file that's in use, so it's just overwritten
+	(void)sync;
+	(void)codec;
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+	if (fd < 0)
+		return -1;
+
+	ssize_t written = lb_write_to_fd(lb, fd);
+	if (close(fd) != 0)
+		return -1;
+	return written;
+#else
+	char *target = lb_write_target(path);
+	char *temp = NULL;
+	ssize_t written = -1;
+	int fd;
+	mode_t mode = 0;
+	if (lb_replaceable(target)) {
+		size_t target_len = strlen(target);
+		temp = malloc(target_len + sizeof(".XXXXXX"));
+		assert(temp != NULL && "Could not allocate memory");
+		memcpy(temp, target, target_len);
+		memcpy(temp + target_len, ".XXXXXX", sizeof(".XXXXXX"));
+		fd = mkstemp(temp);
+		// the program compressing into it gets it as its output, and
+		// no other program started meanwhile should hold on to it
+		if (fd >= 0)
+			fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+		// the new file takes the place of the old one, so it takes its
+		// permissions as well
+		struct stat st;
+		if (stat(target, &st) == 0) {
+			mode = st.st_mode & 07777;
+		} else {
+			mode_t mask = umask(0);
+			umask(mask);
+			mode = 0666 & ~mask;
+		}
+	} else {
+		// anything else is written into as it is, since a new file
+		// would turn a device or FIFO into a regular file, and lose
+		// the links and owner of a regular one
+		fd = open(target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	}
+	if (fd < 0)
+		goto defer;
+
+	if (codec == NULL) {
+		written = lb_write_to_fd(lb, fd);
+	} else {
+		// the file is only synced once the program compressing into it
+		// is done with it
+		Cz_Pipe pipe;
+		if (cz_compress(codec, fd, &pipe)) {
+			written = lb_write_to_fd(lb, pipe.fd);
+			if (!cz_finish(&pipe))
+				written = -1;
+		}
+	}
+	if (written >= 0 && temp != NULL && fchmod(fd, mode) != 0)
+		written = -1;
+
+	// only regular files can be flushed to disk
+	struct stat st;
+	if (written >= 0 && sync && fstat(fd, &st) == 0 &&
+	    S_ISREG(st.st_mode) && fsync(fd) != 0)
+		written = -1;
+	if (close(fd) != 0)
+		written = -1;
+
+	if (temp != NULL && (written < 0 || rename(temp, target) != 0)) {
+		unlink(temp);
+		written = -1;
+	}
+
+defer:
+	free(temp);
+	free(target);
+	return written;
+#endif // _WIN32
+}
+
+ssize_t lb_write_over(Line_Builder *lb, const char *path, size_t start,
+		      size_t offset, bool sync)
+{
+#ifdef _WIN32
+	// files are never mapped, so there's nothing to gain over rewriting
+	(void)lb;
+	(void)path;
+	(void)start;
+	(void)offset;
+	(void)sync;
+	return -1;
+#else
+	int fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -1;
+
+	ssize_t written = -1;
+	if (lseek(fd, offset, SEEK_SET) == (off_t)-1)
+		goto defer;
+	written = lb_write_from(lb, start, fd);
+	if (written < 0)
+		goto defer;
+
+	written += offset;
+	if (ftruncate(fd, written) != 0 || (sync && fsync(fd) != 0))
+		written = -1;
+
+defer:
+	if (close(fd) != 0)
+		written = -1;
+	return written;
+#endif // _WIN32
+}
+
+void lb_print(Line_Builder *lb, size_t start, size_t end)
+{
+	size_t *len;
+	Lb_Iter it = lb_iter(lb, start - 1);
+	for (size_t i = start; i <= end; ++i) {
+		char *line = *lb_iter_next(&it, &len);
+		ob_write(line, *len);
+	}
+}
+
+void lb_printn(Line_Builder *lb, size_t start, size_t end)
+{
+	size_t *len;
+	Lb_Iter it = lb_iter(lb, start - 1);
+	for (size_t i = start; i <= end; ++i) {
+		char *line = *lb_iter_next(&it, &len);
+		ob_size(i);
+		ob_putc('\t');
+		ob_write(line, *len);
+	}
 }
@@ -4,6 +4,8 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "../da.h"
+#include "./cz.h"
+#include "./la.h"
 
 #ifdef _WIN32
 #include "./getline.h"
@@ -12,105 +14,193 @@
 #define PRISize "%zu"
 #endif // _WIN32
 
-// Dynamic array of lines (nul-terminated with the '\n' at the end)
-typedef da(char *) Line_Builder;
-
-// Read lines from `stream` into `lb` until `condition` is met.
-// Passing `""` as the condition will read until EOF.
-ssize_t lb_read_from_stream(Line_Builder *lb, FILE *file, char *condition);
+// Maximum amount of lines in a leaf of a `Line_Builder`.
+#define LB_LEAF_CAP 64
+// Maximum amount of children of an inner node of a `Line_Builder`.
+#define LB_NODE_CAP 32
+
+typedef struct Lb_Node Lb_Node;
+
+// A node of a `Line_Builder`.
+//
+// Leaves hold the lines themselves and are linked together in order.
+// Inner nodes hold their children along with the amount of lines under each.
+struct Lb_Node {
+	size_t length;
+	union {
+		struct {
+			size_t counts[LB_NODE_CAP];
+			Lb_Node *children[LB_NODE_CAP];
+		};
+		struct {
+			Lb_Node *next;
+			// lengths are kept alongside the lines, so that lines
+			// never need to be scanned to find their end
+			char *lines[LB_LEAF_CAP];
+			size_t lens[LB_LEAF_CAP];
+		};
+	};
+};
+
+// Balanced tree of lines (with the '\n' at the end) and their lengths,
+// indexed by line number.
+//
+// Lines are either allocated with `la_alloc`, or point straight into a file
+// mapped with `la_map`. Either way only their stored length says where they
+// end, as they may hold '\0's and aren't necessarily nul-terminated.
+typedef struct {
+	Lb_Node *root;
+	// amount of inner levels above the leaves
+	size_t height;
+	size_t count;
+	// sum of the lengths of all lines, which is what writing them out takes
+	size_t bytes;
+} Line_Builder;
+
+// Position of a line within a `Line_Builder`, used to walk its lines in order.
+typedef struct {
+	Lb_Node *leaf;
+	size_t slot;
+} Lb_Iter;
+
+// Read lines from STDIN into `lb` until a line with just `"."` is
+// encountered.
+ssize_t lb_read_to_dot(Line_Builder *lb);
+
+// Read lines from `file` into `lb` until EOF, a large block at a time.
+ssize_t lb_read_file(Line_Builder *lb, FILE *file);
+
+// Append the lines of the `size` bytes at `data` to `lb`, pointing into `data`
+// rather than copying them, which must have been mapped with `la_map`.
+ssize_t lb_read_mapped(Line_Builder *lb, char *data, size_t size);
+
+// Get the line at `index`, and set `len` to its length.
+char *lb_get(Line_Builder *lb, size_t index, size_t *len);
+
+// Append a line of length `len` to a `Line_Builder`.
+void lb_append(Line_Builder *lb, char *line, size_t len);
 
 // Insert the contents of `source` into `target` at `index`,
 // pushing off the contents of `target` to make room.
+// `source` is left empty.
 void lb_insert(Line_Builder *target, Line_Builder *source, size_t index);
 
-// Insert the contents of `source` into `target` at `index`,
-// while removing the line at `index` from the target.
-void lb_overwrite(Line_Builder *target, Line_Builder *source, size_t start,
-		  size_t end);
-
 // Remove the lines between `start` and `end` from `target`.
 void lb_pop(Line_Builder *target, size_t start, size_t end);
 
+// Move the lines between `start` and `end` from `target` to the end of `out`,
+// without freeing them.
+void lb_take(Line_Builder *target, size_t start, size_t end, Line_Builder *out);
+
+// Move the lines at the `count` ascending `indices` of `target` to the end of
+// `out`, without freeing them.
+void lb_take_many(Line_Builder *target, const size_t *indices, size_t count,
+		  Line_Builder *out);
+
+// Append the lines between `start` and `end` of `source` to `out`, sharing
+// them rather than copying their text.
+void lb_copy(Line_Builder *source, size_t start, size_t end,
+	     Line_Builder *out);
+
 // Check if `n` is within the range of `lb`.
 bool lb_contains(Line_Builder lb, size_t n);
 
-// Swap between `a` and `b`.
-void lb_swap(Line_Builder *a, Line_Builder *b);
-
-// Make `b` into a clone of `a`.
-void lb_clone(Line_Builder *a, Line_Builder *b);
-
-// Append a line to a `Line_Builder`
-#define lb_append(lb, line) da_append(lb, line)
-
-// Iterate over a `Line_Builder`'s lines by pointer
-#define lb_foreach(line, lb) da_foreach(line, lb)
-
-// Write all lines from `lb` into `stream`.
-#define lb_write_to_stream(lb, stream)        \
-	lb_foreach(line, lb)                  \
-	{                                     \
-		if (fputs(*line, stream) < 0) \
-			break;                \
-	}
-
-// Wrapper around `lb_read_from_stream` that reads lines from STDIN
-// until a line with just `"."` is encountered.
-#define lb_read_to_dot(lb) lb_read_from_stream(lb, stdin, ".\n")
-
-// Wrapper around `lb_read_from_stream` that reads lines from `file` until EOF.
-#define lb_read_file(lb, file) lb_read_from_stream(lb, file, "")
-
-// Print lines from `lb` into `STDOUT`
-#define lb_print(lb, start, end)                        \
-	do {                                            \
-		for (size_t i = start - 1; i < end; ++i) { \
-			printf("%s", lb.items[i]);      \
-		}                                       \
-	} while (0);
-
-// Print lines and their line numbers from `lb` into `STDOUT`
-#define lb_printn(lb, start, end)                             \
-	do {                                                  \
-		for (size_t i = start - 1; i < end; ++i) {       \
-			printf(PRISize "\t%s", i + 1, lb.items[i]); \
-		}                                             \
-	} while (0);
-
-// Free the allocated pointers in `lb`.
-#define lb_free(lb)                     \
-	do {                            \
-		da_foreach(line, lb)    \
-		{                       \
-			free(*line);    \
-		}                       \
-		if (lb.items != NULL)   \
-			free(lb.items); \
-	} while (0);
-
-#define lb_clear(lb)             \
-	do {                     \
-		lb_free((lb));     \
-		(lb).count = 0;    \
-		(lb).capacity = 0; \
-		(lb).items = NULL; \
-	} while (0);
-
-#define realloc_chunk(target, amount)                                       \
-	do {                                                                \
-		if (target->count + amount > target->capacity) {            \
-			if (target->capacity == 0)                          \
-				target->capacity = DA_CAP_INIT;             \
-			while (target->count + amount > target->capacity) { \
-				target->capacity *= 2;                      \
-			}                                                   \
-			target->items = realloc(                            \
-				target->items,                              \
-				target->capacity * sizeof(*target->items)); \
-			assert(target->items != NULL &&                     \
-			       "Could not reallocate memory");              \
-		}                                                           \
-	} while (0);
-
+// Free the lines and nodes of `lb`.
+void lb_free(Line_Builder *lb);
+
+// Free the nodes of `lb`, leaving its lines to be freed all at once
+// with `la_release`.
+void lb_release(Line_Builder *lb);
+
+// Free the lines and nodes of `lb`, leaving it empty.
+void lb_clear(Line_Builder *lb);
+
+// Start iterating over the lines of `lb` from `index`.
+Lb_Iter lb_iter(Line_Builder *lb, size_t index);
+
+// Advance `it`, returning a pointer to the line it was on and setting `len`
+// to point to its length, or returning `NULL` once there are no more lines.
+char **lb_iter_next(Lb_Iter *it, size_t **len);
+
+// Put `line` of length `len` in place of the line `it` was last on, returning
+// the line it replaces and setting `old_len` to its length.
+char *lb_iter_swap(Line_Builder *lb, Lb_Iter *it, char *line, size_t len,
+		   size_t *old_len);
+
+// Swap the lines from `first` up to `middle` of `lb` with those from `middle`
+// up to `last`, moving each line pointer of the range once.
+void lb_rotate(Line_Builder *lb, size_t first, size_t middle, size_t last);
+
+// Iterate over a `Line_Builder`'s lines and their lengths by pointer
+#define lb_foreach(line, len, lb)                                            \
+	for (Lb_Iter line##_iter = lb_iter(&(lb), 0), *line##_once =         \
+						   &line##_iter;             \
+	     line##_once != NULL; line##_once = NULL)                        \
+		for (size_t *len = NULL; line##_once != NULL;                \
+		     line##_once = NULL)                                     \
+			for (char **line;                                    \
+			     (line = lb_iter_next(&line##_iter, &len)) != NULL;)
+
+// Copy the lines of `lb` from `start` on which point into `file` past
+// `offset` into the arena, so that the file can be overwritten from there on.
+void lb_privatize(Line_Builder *lb, size_t start, La_File file,
+		  size_t offset);
+
+// Copy the lines of `lb` which point into a mapped file into the arena, so
+// that `lb` no longer keeps any file mapped.
+void lb_detach(Line_Builder *lb);
+
+// Point the lines of `lb` from `start` on at `data`, which holds the same text
+// laid out one line after the other in a file mapped with `la_map`, freeing
+// the lines they pointed to.
+void lb_point_into(Line_Builder *lb, size_t start, char *data);
+
+// Maximum amount of lines handed to the kernel at once when writing.
+#define LB_WRITE_BATCH 1024
+
+// Write all lines from `lb` into the file descriptor `fd`.
+//
+// Returns the amount of bytes written, or -1 upon failure.
+ssize_t lb_write_to_fd(Line_Builder *lb, int fd);
+
+// Replace the file at `path` with the lines of `lb`, by writing them into a
+// temporary file next to it and renaming that over it, so that `path` never
+// holds a partially written buffer. The temporary file is flushed to disk
+// before the rename if `sync` is set.
+//
+// A file that can't be replaced without losing what it is, as decided by
+// `lb_write_replaces`, is written into instead.
+//
+// If `codec` isn't `NULL`, the lines are compressed with it on their way into
+// the file.
+//
+// Returns the amount of bytes of lines written, or -1 upon failure.
+ssize_t lb_write_file(Line_Builder *lb, const char *path, bool sync,
+		      const Cz_Codec *codec);
+
+// Whether `lb_write_file` replaces the file at `path` with a new one, rather
+// than writing into it, which it only does for a regular file with no other
+// links, owned by the user, in a directory they can write to.
+bool lb_write_replaces(const char *path);
+
+// Overwrite the file at `path` from byte `offset` on with the lines of `lb`
+// from `start` on, cutting it off right after them, so that what comes before
+// `offset` is left untouched. The file is flushed to disk if `sync` is set.
+//
+// Unlike with `lb_write_file`, lines which point into the file past `offset`
+// are overwritten along with it, and a failed write leaves the file partially
+// written.
+//
+// Returns the size of the file, or -1 upon failure.
+ssize_t lb_write_over(Line_Builder *lb, const char *path, size_t start,
+		      size_t offset, bool sync);
+
+// Print lines `start` through `end` (counting from 1) from `lb` into the
+// output buffer
+void lb_print(Line_Builder *lb, size_t start, size_t end);
+
+// Print lines `start` through `end` (counting from 1) and their line numbers
+// from `lb` into the output buffer
+void lb_printn(Line_Builder *lb, size_t start, size_t end);
 
 #endif // LB_H_
@@ -0,0 +1,186 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif // _WIN32
+
+#include "./la.h"
+#include "./ld.h"
+#include "./nl.h"
+
+// Struct with the state of the file being loaded.
+typedef struct {
+	char *data;
+	Ld_Progress progress;
+	// whether the thread is still running, or has lines left to hand over
+	bool active;
+#ifndef _WIN32
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t loaded;
+	// lines loaded but not handed over yet, behind `lock` like `progress`
+	Line_Builder ready;
+	bool cancel;
+#endif // _WIN32
+} Ld_Loader;
+
+// Instance of `Ld_Loader` that is shared globally.
+static Ld_Loader ld_global_loader = {
+	.active = false,
+#ifndef _WIN32
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.loaded = PTHREAD_COND_INITIALIZER,
+#endif // _WIN32
+};
+
+#ifndef _WIN32
+// Publish the lines of `chunk` and how far loading has gotten, returning
+// whether to keep loading.
+static bool ld_publish(Line_Builder *chunk, size_t bytes, bool done)
+{
+	Ld_Loader *ld = &ld_global_loader;
+
+	pthread_mutex_lock(&ld->lock);
+	ld->progress.lines += chunk->count;
+	ld->progress.bytes = bytes;
+	ld->progress.done = done;
+	lb_insert(&ld->ready, chunk, ld->ready.count);
+	bool cancel = ld->cancel;
+	pthread_cond_broadcast(&ld->loaded);
+	pthread_mutex_unlock(&ld->lock);
+
+	return !cancel;
+}
+
+// Main loop of the thread, which indexes the file a block at a time.
+static void *ld_work(void *arg)
+{
+	Ld_Loader *ld = &ld_global_loader;
+	(void)arg;
+
+	char *data = ld->data;
+	size_t size = ld->progress.size;
+	uint32_t *ends = malloc(NL_BLOCK_SIZE * sizeof(*ends));
+	assert(ends != NULL && "Could not allocate memory");
+
+	Line_Builder chunk = { 0 };
+	char *line = data;
+	for (size_t offset = 0; offset < size; offset += NL_BLOCK_SIZE) {
+		size_t scanned = size - offset < NL_BLOCK_SIZE ?
+					 size - offset :
+					 NL_BLOCK_SIZE;
+		size_t count = nl_index(data + offset, scanned, ends);
+		for (size_t i = 0; i < count; ++i) {
+			char *end = data + offset + ends[i] + 1;
+			lb_append(&chunk, line, end - line);
+			line = end;
+		}
+
+		// the first lines are handed over right away, so that they can
+		// be worked on as soon as possible
+		if (chunk.count >= LD_CHUNK_LINES || offset == 0) {
+			if (!ld_publish(&chunk, line - data, false))
+				goto defer;
+		}
+	}
+
+	if (line < data + size)
+		lb_append(&chunk, line, data + size - line);
+	ld_publish(&chunk, size, true);
+
+defer:
+	lb_release(&chunk);
+	free(ends);
+	return NULL;
+}
+#endif // _WIN32
+
+bool ld_start(char *data, size_t size)
+{
+#ifdef _WIN32
+	(void)data;
+	(void)size;
+	return false;
+#else
+	Ld_Loader *ld = &ld_global_loader;
+	assert(!ld->active && "Only one file is loaded at a time");
+
+	ld->data = data;
+	ld->progress = (Ld_Progress){ .size = size };
+	ld->cancel = false;
+	if (pthread_create(&ld->thread, NULL, ld_work, NULL) != 0)
+		return false;
+
+	ld->active = true;
+	return true;
+#endif // _WIN32
+}
+
+bool ld_loading(void)
+{
+	return ld_global_loader.active;
+}
+
+void ld_take(Line_Builder *lb, size_t lines)
+{
+#ifdef _WIN32
+	(void)lb;
+	(void)lines;
+#else
+	Ld_Loader *ld = &ld_global_loader;
+	if (!ld->active)
+		return;
+
+	pthread_mutex_lock(&ld->lock);
+	while (ld->ready.count < lines && !ld->progress.done)
+		pthread_cond_wait(&ld->loaded, &ld->lock);
+	Line_Builder ready = ld->ready;
+	ld->ready = (Line_Builder){ 0 };
+	bool done = ld->progress.done;
+	pthread_mutex_unlock(&ld->lock);
+
+	la_hold(ld->data, ready.count);
+	lb_insert(lb, &ready, lb->count);
+	if (done) {
+		pthread_join(ld->thread, NULL);
+		la_free(ld->data);
+		ld->active = false;
+	}
+#endif // _WIN32
+}
+
+Ld_Progress ld_progress(void)
+{
+	Ld_Loader *ld = &ld_global_loader;
+
+#ifndef _WIN32
+	pthread_mutex_lock(&ld->lock);
+#endif // _WIN32
+	Ld_Progress progress = ld->progress;
+#ifndef _WIN32
+	pthread_mutex_unlock(&ld->lock);
+#endif // _WIN32
+
+	return progress;
+}
+
+void ld_cancel(void)
+{
+#ifndef _WIN32
+	Ld_Loader *ld = &ld_global_loader;
+	if (!ld->active)
+		return;
+
+	pthread_mutex_lock(&ld->lock);
+	ld->cancel = true;
+	pthread_mutex_unlock(&ld->lock);
+
+	pthread_join(ld->thread, NULL);
+	lb_release(&ld->ready);
+	ld->ready = (Line_Builder){ 0 };
+	la_free(ld->data);
+	ld->active = false;
+#endif // _WIN32
+}
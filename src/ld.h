@@ -0,0 +1,47 @@
+#ifndef LD_H_
+#define LD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "./lb.h"
+
+// Loading of the lines of a mapped file on a thread of its own, which hands
+// them over a chunk at a time while the file is still being loaded.
+
+// Amount of lines loaded before they're handed over.
+#define LD_CHUNK_LINES 65536
+
+// How far loading has gotten.
+typedef struct {
+	// lines loaded so far, whether or not they were handed over
+	size_t lines;
+	size_t bytes;
+	// size of the whole file
+	size_t size;
+	bool done;
+} Ld_Progress;
+
+// Start loading the lines of the `size` bytes at `data`, mapped with `la_map`.
+//
+// The caller's hold on the mapping is taken over, and dropped once every line
+// was handed over or loading is cancelled.
+//
+// Returns `false` if no thread could be started to load them with, in which
+// case nothing is loaded and the hold stays with the caller.
+bool ld_start(char *data, size_t size);
+
+// Whether there are lines that are yet to be handed over.
+bool ld_loading(void);
+
+// Wait until at least `lines` lines are loaded but not handed over, or there
+// are no more to come, then move every loaded line to the end of `lb`.
+void ld_take(Line_Builder *lb, size_t lines);
+
+// Get how far loading has gotten.
+Ld_Progress ld_progress(void);
+
+// Stop loading, dropping the lines that weren't handed over.
+void ld_cancel(void);
+
+#endif // LD_H_
@@ -4,31 +4,97 @@
 #include <string.h>
 #include <stdlib.h>
 
+#define FLAG_IMPLEMENTATION
+#include "../flag.h"
+
 #include "./ed.h"
+#include "./ob.h"
+
+void usage(FILE *stream)
+{
+	fprintf(stream, "Usage: ./main [OPTIONS]\n");
+	fprintf(stream, "\n");
+	fprintf(stream, "Options:\n");
+	flag_print_options(stream);
+}
 
-int main(void)
+int main(int argc, char **argv)
 {
-	char *line = NULL;
-	size_t nsize = 0;
+	bool *help = flag_bool("-help", false, "Print this help and exit");
+	flag_add_alias(help, "h");
+	bool *script = flag_bool(
+		"-script", false,
+		"Don't print byte counts or diagnostics, for running scripts");
+	flag_add_alias(script, "s");
+	bool *no_sync = flag_bool("-no-sync", false,
+				  "Don't flush written files to disk");
+	size_t *threads = flag_size(
+		"-threads", 0,
+		"Threads to scan for patterns with (0 for one per CPU)");
+	size_t *parallel_lines =
+		flag_size("-parallel-lines", 262144,
+			  "Lines needed to scan for patterns in parallel");
+	bool *journal = flag_bool(
+		"-journal", false,
+		"Journal changes next to the file being edited until written");
+	size_t *journal_sync = flag_size(
+		"-journal-sync", 1,
+		"Changes journaled between flushes to disk (0 for never)");
+	size_t *memory_budget = flag_size(
+		"-memory-budget", 0,
+		"Bytes of lines kept in memory before spilling to a scratch file "
+		"(0 for no limit)");
+	char **recover = flag_str(
+		"-recover", "",
+		"Edit the given file with the changes left in its journal");
+
+	if (!flag_parse(argc, argv)) {
+		usage(stderr);
+		flag_print_error(stderr);
+		return 1;
+	}
+
+	if (*help) {
+		usage(stdout);
+		return 0;
+	}
+
+	ed_init((Ed_Options){ .sync = !*no_sync,
+			      .threads = *threads,
+			      .parallel_lines = *parallel_lines,
+			      .script = *script,
+			      .journal = *journal,
+			      .journal_sync = *journal_sync,
+			      .memory_budget = *memory_budget });
+
+	if (strlen(*recover) != 0 && !ed_recover(*recover)) {
+		ob_puts("?\n");
+		if (ed_should_print_error())
+			ed_print_error();
+	}
+
+	// every command is read into the same buffer
+	String_Builder line = { 0 };
 
 	bool quit = false;
 	while (!quit) {
-		line = NULL;
-		nsize = 0;
-		ssize_t nread = ed_getline(&line, &nsize, stdin);
-		char *copy = line;
+		ssize_t nread = ed_getline(&line);
+		// running out of commands still deletes the journal, as
+		// the session ended rather than crashed
 		if (nread < 0) {
+			free(line.items);
+			ed_cleanup();
 			return 1;
 		}
-		bool success = ed_handle_cmd(line, &quit);
-		free(copy);
+		bool success = ed_handle_cmd(line.items, &quit);
 		if (!success) {
-			printf("?\n");
+			ob_puts("?\n");
 			if (ed_should_print_error())
 				ed_print_error();
 		}
 	}
 
+	free(line.items);
 	ed_cleanup();
 	return 0;
 }
@@ -0,0 +1,90 @@
+#include <string.h>
+
+#include "./nl.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define NL_X86
+#include <immintrin.h>
+#endif
+
+// Index the '\n's of `data` one `memchr` at a time, numbering them from
+// `offset`.
+static size_t nl_index_scalar(const char *data, size_t size, uint32_t *ends,
+			      size_t offset)
+{
+	size_t count = 0;
+	const char *end = data + size;
+	for (const char *c = data; (c = memchr(c, '\n', end - c)) != NULL;
+	     ++c)
+		ends[count++] = offset + (c - data);
+	return count;
+}
+
+#ifdef NL_X86
+// Write the offset of the '\n' each set bit of `mask` stands for, that many
+// bytes past `offset`, to `ends`, returning how many there are.
+static inline size_t nl_index_mask(uint32_t mask, size_t offset,
+				   uint32_t *ends)
+{
+	size_t count = 0;
+	for (; mask != 0; mask &= mask - 1)
+		ends[count++] = offset + __builtin_ctz(mask);
+	return count;
+}
+
+__attribute__((target("sse2"))) static size_t
+nl_index_sse2(const char *data, size_t size, uint32_t *ends)
+{
+	__m128i newline = _mm_set1_epi8('\n');
+	size_t count = 0;
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i *)(data + i));
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(
+			_mm_cmpeq_epi8(bytes, newline));
+		count += nl_index_mask(mask, i, ends + count);
+	}
+	return count + nl_index_scalar(data + i, size - i, ends + count, i);
+}
+
+__attribute__((target("avx2"))) static size_t
+nl_index_avx2(const char *data, size_t size, uint32_t *ends)
+{
+	__m256i newline = _mm256_set1_epi8('\n');
+	size_t count = 0;
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		__m256i bytes =
+			_mm256_loadu_si256((const __m256i *)(data + i));
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(bytes, newline));
+		count += nl_index_mask(mask, i, ends + count);
+	}
+	return count + nl_index_scalar(data + i, size - i, ends + count, i);
+}
+#endif // NL_X86
+
+static size_t nl_index_default(const char *data, size_t size, uint32_t *ends)
+{
+	return nl_index_scalar(data, size, ends, 0);
+}
+
+// Widest scan the CPU can run, picked by `nl_init`.
+static size_t (*nl_index_impl)(const char *, size_t, uint32_t *) =
+	nl_index_default;
+
+void nl_init(void)
+{
+#ifdef NL_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		nl_index_impl = nl_index_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		nl_index_impl = nl_index_sse2;
+#endif // NL_X86
+}
+
+size_t nl_index(const char *data, size_t size, uint32_t *ends)
+{
+	return nl_index_impl(data, size, ends);
+}
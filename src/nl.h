@@ -0,0 +1,24 @@
+#ifndef NL_H_
+#define NL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Scanning of text for the '\n's that end its lines, a vector at a time with
+// AVX2 or SSE2 when the CPU has them.
+
+// Maximum amount of bytes scanned at once.
+#define NL_BLOCK_SIZE (1 << 16)
+
+// Pick the widest scan the CPU can run, before any thread scans, as the
+// choice isn't synchronized. Scans are done with `memchr` until then.
+void nl_init(void);
+
+// Write the offset of every '\n' in the `size` bytes at `data` to `ends`,
+// returning how many there are.
+//
+// `size` may be at most `NL_BLOCK_SIZE`, and `ends` must have room for as
+// many offsets.
+size_t nl_index(const char *data, size_t size, uint32_t *ends);
+
+#endif // NL_H_
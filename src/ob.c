@@ -0,0 +1,77 @@
+#include <string.h>
+#include <unistd.h>
+
+#include "./ob.h"
+
+// Struct with the state of the output buffer.
+typedef struct {
+	char items[OB_CAP];
+	size_t count;
+} Ob_Buffer;
+
+// Instance of `Ob_Buffer` that is shared globally.
+static Ob_Buffer ob_global_buffer = { .items = { 0 }, .count = 0 };
+
+// Write all of `data` into STDOUT, however many calls it takes.
+static void ob_write_all(const char *data, size_t len)
+{
+	while (len > 0) {
+		ssize_t written = write(STDOUT_FILENO, data, len);
+		if (written <= 0)
+			return;
+		data += written;
+		len -= written;
+	}
+}
+
+void ob_write(const char *data, size_t len)
+{
+	Ob_Buffer *ob = &ob_global_buffer;
+
+	if (ob->count + len > OB_CAP) {
+		ob_flush();
+		// no point in copying what would fill the buffer by itself
+		if (len >= OB_CAP) {
+			ob_write_all(data, len);
+			return;
+		}
+	}
+
+	memcpy(ob->items + ob->count, data, len);
+	ob->count += len;
+}
+
+void ob_puts(const char *s)
+{
+	ob_write(s, strlen(s));
+}
+
+void ob_putc(char c)
+{
+	Ob_Buffer *ob = &ob_global_buffer;
+
+	if (ob->count == OB_CAP)
+		ob_flush();
+	ob->items[ob->count++] = c;
+}
+
+void ob_size(size_t n)
+{
+	// digits are written from the end, so that they needn't be reversed
+	char digits[20];
+	size_t i = sizeof(digits);
+	do {
+		digits[--i] = '0' + n % 10;
+		n /= 10;
+	} while (n > 0);
+
+	ob_write(digits + i, sizeof(digits) - i);
+}
+
+void ob_flush(void)
+{
+	Ob_Buffer *ob = &ob_global_buffer;
+
+	ob_write_all(ob->items, ob->count);
+	ob->count = 0;
+}
@@ -0,0 +1,27 @@
+#ifndef OB_H_
+#define OB_H_
+
+#include <stddef.h>
+
+// Everything printed to STDOUT goes through the output buffer, which is only
+// written out once it fills up or `ob_flush` is called.
+
+// Size of the output buffer.
+#define OB_CAP (1 << 20)
+
+// Append the `len` bytes of `data` to the output buffer.
+void ob_write(const char *data, size_t len);
+
+// Append a nul-terminated string to the output buffer.
+void ob_puts(const char *s);
+
+// Append a single character to the output buffer.
+void ob_putc(char c);
+
+// Append the decimal representation of `n` to the output buffer.
+void ob_size(size_t n);
+
+// Write out everything in the output buffer.
+void ob_flush(void);
+
+#endif // OB_H_
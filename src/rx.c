@@ -0,0 +1,163 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <regex.h>
+#endif // _WIN32
+
+#include "./rx.h"
+
+struct Rx {
+	char *pattern;
+	// value of the cache's clock when the pattern was last used
+	uint64_t used;
+#ifndef _WIN32
+	regex_t regex;
+#endif // _WIN32
+};
+
+// Struct with the cache of compiled patterns.
+typedef struct {
+	Rx items[RX_CACHE_CAP];
+	size_t count;
+	uint64_t clock;
+} Rx_Cache;
+
+// Instance of `Rx_Cache` that is shared globally.
+static Rx_Cache rx_global_cache = { .items = { { 0 } },
+				    .count = 0,
+				    .clock = 0 };
+
+// Free the pattern of `rx`, leaving its entry empty.
+static void rx_free(Rx *rx)
+{
+	if (rx->pattern == NULL)
+		return;
+
+#ifndef _WIN32
+	regfree(&rx->regex);
+#endif // _WIN32
+	free(rx->pattern);
+	rx->pattern = NULL;
+	rx->used = 0;
+}
+
+Rx *rx_compile(const char *pattern)
+{
+	Rx_Cache *cache = &rx_global_cache;
+	cache->clock += 1;
+
+	// the least recently used pattern makes room for the new one
+	Rx *rx = NULL;
+	for (size_t i = 0; i < cache->count; ++i) {
+		Rx *entry = &cache->items[i];
+		if (entry->pattern != NULL &&
+		    strcmp(entry->pattern, pattern) == 0) {
+			entry->used = cache->clock;
+			return entry;
+		}
+		if (rx == NULL || entry->used < rx->used)
+			rx = entry;
+	}
+
+	if (cache->count < RX_CACHE_CAP) {
+		rx = &cache->items[cache->count++];
+	} else {
+		rx_free(rx);
+	}
+
+#ifndef _WIN32
+	// the entry is left empty for the next pattern
+	if (regcomp(&rx->regex, pattern, 0) != 0)
+		return NULL;
+#endif // _WIN32
+
+	rx->pattern = strdup(pattern);
+	assert(rx->pattern != NULL && "Could not allocate memory");
+	rx->used = cache->clock;
+	return rx;
+}
+
+bool rx_match(Rx *rx, const char *line, size_t len, size_t from,
+	      Rx_Span *spans, size_t count)
+{
+#ifdef _WIN32
+	// without regex.h, patterns are only matched literally
+	size_t pattern_len = strlen(rx->pattern);
+	for (size_t i = from; i + pattern_len <= len; ++i) {
+		if (memcmp(line + i, rx->pattern, pattern_len) == 0) {
+			if (count > 0) {
+				spans[0].start = i;
+				spans[0].end = i + pattern_len;
+			}
+			for (size_t j = 1; j < count; ++j)
+				spans[j].start = spans[j].end = i;
+			return true;
+		}
+	}
+	return false;
+#else
+	assert(count <= RX_SPAN_CAP);
+
+	// REG_STARTEND has the match end at the given length, rather than at
+	// the first '\0'
+	regmatch_t matches[RX_SPAN_CAP];
+	matches[0].rm_so = from;
+	matches[0].rm_eo = len;
+	int flags = REG_STARTEND | (from > 0 ? REG_NOTBOL : 0);
+	if (regexec(&rx->regex, line, count == 0 ? 1 : count, matches,
+		    flags) != 0)
+		return false;
+
+	for (size_t i = 0; i < count; ++i) {
+		if (matches[i].rm_so < 0)
+			matches[i].rm_so = matches[i].rm_eo = 0;
+		spans[i].start = matches[i].rm_so;
+		spans[i].end = matches[i].rm_eo;
+	}
+	return true;
+#endif // _WIN32
+}
+
+Rx *rx_copy(Rx *rx, Rx *copy)
+{
+	if (copy != NULL && strcmp(copy->pattern, rx->pattern) == 0)
+		return copy;
+	rx_copy_free(copy);
+
+	copy = calloc(1, sizeof(*copy));
+	assert(copy != NULL && "Could not allocate memory");
+
+	// the matcher serializes calls on the same pattern, so the copy has to
+	// be compiled anew
+#ifndef _WIN32
+	if (regcomp(&copy->regex, rx->pattern, 0) != 0) {
+		free(copy);
+		return NULL;
+	}
+#endif // _WIN32
+
+	copy->pattern = strdup(rx->pattern);
+	assert(copy->pattern != NULL && "Could not allocate memory");
+	return copy;
+}
+
+void rx_copy_free(Rx *copy)
+{
+	if (copy == NULL)
+		return;
+
+	rx_free(copy);
+	free(copy);
+}
+
+void rx_release(void)
+{
+	Rx_Cache *cache = &rx_global_cache;
+
+	for (size_t i = 0; i < cache->count; ++i)
+		rx_free(&cache->items[i]);
+	cache->count = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef RX_H_
+#define RX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Maximum amount of compiled patterns kept around at once.
+#define RX_CACHE_CAP 32
+
+// A compiled (basic) regular expression.
+//
+// Patterns are owned by the cache, and stay valid until `RX_CACHE_CAP` other
+// patterns have been compiled since they were last used.
+typedef struct Rx Rx;
+
+// Where a match, or one of its subexpressions, starts and ends within a line.
+typedef struct {
+	size_t start;
+	size_t end;
+} Rx_Span;
+
+// Compile `pattern`, or get it from the cache if it was compiled before.
+//
+// Returns `NULL` if the pattern isn't valid.
+Rx *rx_compile(const char *pattern);
+
+// Maximum amount of spans reported by `rx_match`, the match itself included.
+#define RX_SPAN_CAP 10
+
+// Search the `len` bytes of `line` for `rx` starting at `from`, where `line`
+// needn't be nul-terminated.
+//
+// If it matches, the first `count` entries of `spans` are set to where the
+// match and its subexpressions are, counting from the start of `line`.
+// Subexpressions that didn't take part in the match are left empty.
+bool rx_match(Rx *rx, const char *line, size_t len, size_t from,
+	      Rx_Span *spans, size_t count);
+
+// Compile a private copy of `rx`, which another thread can match with while
+// `rx` is in use, reusing `copy` if it's a copy of the same pattern already.
+//
+// Copies aren't part of the cache, and must be freed with `rx_copy_free`.
+Rx *rx_copy(Rx *rx, Rx *copy);
+
+// Free a copy made with `rx_copy`.
+void rx_copy_free(Rx *copy);
+
+// Free every compiled pattern.
+void rx_release(void);
+
+#endif // RX_H_
@@ -0,0 +1,314 @@
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include "./sc.h"
+
+// A single scan, split into chunks of `SC_CHUNK_LINES` lines which threads
+// take on one at a time.
+//
+// Chunks are numbered in the order the scan goes in, so that when finding a
+// line, the match in the lowest chunk is the one that counts.
+typedef struct {
+	Line_Builder *lb;
+	Rx *rx;
+	size_t start;
+	size_t end;
+	size_t chunks;
+	bool forward;
+	// whether every line is marked, rather than a single one found
+	bool mark;
+	bool matching;
+
+	atomic_size_t next_chunk;
+	// lowest chunk a line was found in, past which there's no point looking
+	atomic_size_t found_chunk;
+	// line found by each chunk, or marks made by each chunk
+	size_t *found;
+	Sc_Marks *marks;
+} Sc_Job;
+
+#ifndef _WIN32
+// A thread of the pool, with its own copy of the pattern being scanned for.
+typedef struct {
+	pthread_t thread;
+	Rx *rx;
+} Sc_Worker;
+#endif // _WIN32
+
+// Struct with the state of the pool of threads.
+typedef struct {
+	size_t min_lines;
+#ifndef _WIN32
+	// threads to start the pool with, which only happens once a scan is
+	// large enough to need them
+	size_t threads;
+	bool started;
+	Sc_Worker *workers;
+	size_t count;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	// the workers pick up `job` whenever `generation` changes
+	Sc_Job *job;
+	size_t generation;
+	size_t running;
+	bool quit;
+#endif // _WIN32
+} Sc_Pool;
+
+// Instance of `Sc_Pool` that is shared globally.
+static Sc_Pool sc_global_pool = {
+	.min_lines = SIZE_MAX,
+#ifndef _WIN32
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.start = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+#endif // _WIN32
+};
+
+bool sc_line_matches(Rx *rx, const char *line, size_t len)
+{
+	if (len > 0 && line[len - 1] == '\n')
+		len -= 1;
+	return rx_match(rx, line, len, 0, NULL, 0);
+}
+
+// Scan chunks of `job` with `rx` until there are none left worth scanning.
+static void sc_run(Sc_Job *job, Rx *rx)
+{
+	while (true) {
+		size_t chunk = atomic_fetch_add(&job->next_chunk, 1);
+		if (chunk >= job->chunks)
+			return;
+		if (!job->mark && chunk > atomic_load(&job->found_chunk))
+			return;
+
+		size_t offset = chunk * SC_CHUNK_LINES;
+		size_t first, last;
+		if (job->forward) {
+			first = job->start + offset;
+			last = job->end - first < SC_CHUNK_LINES ?
+				       job->end :
+				       first + SC_CHUNK_LINES - 1;
+		} else {
+			last = job->end - offset;
+			first = last - job->start < SC_CHUNK_LINES ?
+					job->start :
+					last - SC_CHUNK_LINES + 1;
+		}
+
+		size_t found = SC_NOT_FOUND;
+		size_t *len;
+		Lb_Iter it = lb_iter(job->lb, first);
+		for (size_t i = first; i <= last; ++i) {
+			char *line = *lb_iter_next(&it, &len);
+			bool matches = sc_line_matches(rx, line, *len);
+
+			if (job->mark) {
+				if (matches == job->matching)
+					da_append(&job->marks[chunk], i);
+			} else if (matches) {
+				// going backward, the last match is the one
+				found = i;
+				if (job->forward)
+					break;
+			}
+		}
+
+		if (found == SC_NOT_FOUND)
+			continue;
+		job->found[chunk] = found;
+		size_t lowest = atomic_load(&job->found_chunk);
+		while (chunk < lowest &&
+		       !atomic_compare_exchange_weak(&job->found_chunk, &lowest,
+						     chunk))
+			;
+	}
+}
+
+#ifndef _WIN32
+// Main loop of a worker, which runs every job it's handed.
+static void *sc_work(void *arg)
+{
+	Sc_Pool *pool = &sc_global_pool;
+	Sc_Worker *worker = arg;
+
+	size_t seen = 0;
+	pthread_mutex_lock(&pool->lock);
+	while (true) {
+		while (!pool->quit && pool->generation == seen)
+			pthread_cond_wait(&pool->start, &pool->lock);
+		if (pool->quit)
+			break;
+
+		seen = pool->generation;
+		Sc_Job *job = pool->job;
+		pthread_mutex_unlock(&pool->lock);
+
+		worker->rx = rx_copy(job->rx, worker->rx);
+		assert(worker->rx != NULL && "Could not copy pattern");
+		sc_run(job, worker->rx);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->running -= 1;
+		if (pool->running == 0)
+			pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+#endif // _WIN32
+
+void sc_init(size_t threads, size_t min_lines)
+{
+	Sc_Pool *pool = &sc_global_pool;
+	pool->min_lines = min_lines;
+
+#ifdef _WIN32
+	(void)threads;
+#else
+	pool->threads = threads;
+#endif // _WIN32
+}
+
+#ifndef _WIN32
+// Start the threads of the pool.
+static void sc_start(void)
+{
+	Sc_Pool *pool = &sc_global_pool;
+	pool->started = true;
+
+	size_t threads = pool->threads;
+	if (threads == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? cpus : 1;
+	}
+
+	// the calling thread does its share of the work as well
+	pool->count = threads - 1;
+	if (pool->count == 0)
+		return;
+
+	pool->workers = calloc(pool->count, sizeof(*pool->workers));
+	assert(pool->workers != NULL && "Could not allocate memory");
+	for (size_t i = 0; i < pool->count; ++i) {
+		if (pthread_create(&pool->workers[i].thread, NULL, sc_work,
+				   &pool->workers[i]) != 0) {
+			pool->count = i;
+			break;
+		}
+	}
+}
+#endif // _WIN32
+
+// Scan with the whole pool if `job` is large enough, or alone otherwise.
+static void sc_dispatch(Sc_Job *job)
+{
+	job->chunks = (job->end - job->start) / SC_CHUNK_LINES + 1;
+	atomic_init(&job->next_chunk, 0);
+	atomic_init(&job->found_chunk, SIZE_MAX);
+
+	job->found = malloc(job->chunks * sizeof(*job->found));
+	assert(job->found != NULL && "Could not allocate memory");
+	if (job->mark) {
+		job->marks = calloc(job->chunks, sizeof(*job->marks));
+		assert(job->marks != NULL && "Could not allocate memory");
+	}
+
+#ifndef _WIN32
+	Sc_Pool *pool = &sc_global_pool;
+	bool large = job->end - job->start + 1 >= pool->min_lines;
+	if (large && !pool->started)
+		sc_start();
+	if (large && pool->count > 0) {
+		pthread_mutex_lock(&pool->lock);
+		pool->job = job;
+		pool->generation += 1;
+		pool->running = pool->count;
+		pthread_cond_broadcast(&pool->start);
+		pthread_mutex_unlock(&pool->lock);
+
+		sc_run(job, job->rx);
+
+		pthread_mutex_lock(&pool->lock);
+		while (pool->running > 0)
+			pthread_cond_wait(&pool->done, &pool->lock);
+		pthread_mutex_unlock(&pool->lock);
+		return;
+	}
+#endif // _WIN32
+
+	sc_run(job, job->rx);
+}
+
+size_t sc_find(Line_Builder *lb, Rx *rx, size_t start, size_t end,
+	       bool forward)
+{
+	Sc_Job job = { .lb = lb,
+		       .rx = rx,
+		       .start = start,
+		       .end = end,
+		       .forward = forward,
+		       .mark = false };
+	sc_dispatch(&job);
+
+	size_t chunk = atomic_load(&job.found_chunk);
+	size_t found = chunk == SIZE_MAX ? SC_NOT_FOUND : job.found[chunk];
+	free(job.found);
+	return found;
+}
+
+void sc_mark(Line_Builder *lb, Rx *rx, size_t start, size_t end,
+	     bool matching, Sc_Marks *marks)
+{
+	Sc_Job job = { .lb = lb,
+		       .rx = rx,
+		       .start = start,
+		       .end = end,
+		       .forward = true,
+		       .mark = true,
+		       .matching = matching };
+	sc_dispatch(&job);
+
+	// chunks were scanned in any order, but are merged in order
+	for (size_t i = 0; i < job.chunks; ++i) {
+		if (job.marks[i].count > 0)
+			da_append_many(marks, job.marks[i].items,
+				       job.marks[i].count);
+		free(job.marks[i].items);
+	}
+	free(job.marks);
+	free(job.found);
+}
+
+void sc_release(void)
+{
+#ifndef _WIN32
+	Sc_Pool *pool = &sc_global_pool;
+	if (!pool->started)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (size_t i = 0; i < pool->count; ++i) {
+		pthread_join(pool->workers[i].thread, NULL);
+		rx_copy_free(pool->workers[i].rx);
+	}
+	free(pool->workers);
+	pool->workers = NULL;
+	pool->count = 0;
+	pool->started = false;
+	pool->quit = false;
+#endif // _WIN32
+}
@@ -0,0 +1,48 @@
+#ifndef SC_H_
+#define SC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../da.h"
+#include "./lb.h"
+#include "./rx.h"
+
+// Scanning of lines for a pattern, which is split across a pool of threads
+// once there are enough lines to scan.
+
+// Amount of lines a thread scans at a time.
+#define SC_CHUNK_LINES 16384
+
+// Value returned by `sc_find` when no line matches.
+#define SC_NOT_FOUND SIZE_MAX
+
+// Indices of lines, in ascending order.
+typedef da(size_t) Sc_Marks;
+
+// Set up the pool with `threads` threads (counting the calling one), or one
+// per CPU if `threads` is 0, to scan at least `min_lines` lines with at once.
+//
+// The threads are only started by the first scan of that many lines.
+void sc_init(size_t threads, size_t min_lines);
+
+// Whether `rx` matches `line` of length `len`, not counting its '\n'.
+bool sc_line_matches(Rx *rx, const char *line, size_t len);
+
+// Find the first line from `start` through `end` of `lb` that `rx` matches,
+// or the last one if not `forward`.
+//
+// Returns its index, or `SC_NOT_FOUND` if no line matches.
+size_t sc_find(Line_Builder *lb, Rx *rx, size_t start, size_t end,
+	       bool forward);
+
+// Append the indices of the lines from `start` through `end` of `lb` that
+// `rx` matches (or doesn't match, if not `matching`) to `marks`.
+void sc_mark(Line_Builder *lb, Rx *rx, size_t start, size_t end,
+	     bool matching, Sc_Marks *marks);
+
+// Stop the pool's threads, if they were started.
+void sc_release(void);
+
+#endif // SC_H_
@@ -0,0 +1,313 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#include "../da.h"
+#include "./sp.h"
+
+// Allocations are rounded up to this, so that anything can be stored in them.
+#define SP_ALIGN 16
+
+#ifndef _WIN32
+// A part of the scratch file mapped into memory, which allocations are
+// carved out of one after the other.
+typedef struct {
+	char *data;
+	size_t size;
+	size_t used;
+	// whether anything was allocated or freed in the segment since it
+	// was last evicted
+	bool dirty;
+} Sp_Segment;
+
+// Freed allocations of the same size, each linked to the next one through
+// its first bytes.
+typedef struct {
+	size_t size;
+	void *head;
+} Sp_Free_List;
+#endif // _WIN32
+
+// Struct with the state of the scratch file.
+typedef struct {
+	size_t budget;
+	// bytes allocated from memory rather than the scratch file
+	size_t used;
+#ifndef _WIN32
+	pthread_mutex_t lock;
+	// scratch file, or -1 until something is first spilled
+	int fd;
+	size_t file_size;
+	// bytes allocated or freed in the scratch file since it was last
+	// evicted, which are likely still in memory
+	size_t dirty;
+	da(Sp_Segment) segments;
+	da(Sp_Free_List) free;
+#endif // _WIN32
+} Sp_Scratch;
+
+// Instance of `Sp_Scratch` that is shared globally.
+static Sp_Scratch sp_global_scratch = {
+	.budget = 0,
+	.used = 0,
+#ifndef _WIN32
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.fd = -1,
+	.file_size = 0,
+	.dirty = 0,
+	.segments = { 0 },
+	.free = { 0 },
+#endif // _WIN32
+};
+
+void sp_init(size_t budget)
+{
+	sp_global_scratch.budget = budget;
+}
+
+#ifndef _WIN32
+// Open a scratch file in `dir`, which is unlinked right away so that it's
+// gone along with `ed`, however `ed` goes.
+static bool sp_open_in(const char *dir)
+{
+	Sp_Scratch *scratch = &sp_global_scratch;
+
+	String_Builder path = { 0 };
+	sb_append_cstr(&path, dir);
+	sb_append_cstr(&path, "/ed-scratch-XXXXXX");
+	sb_append_nul(&path);
+
+	scratch->fd = mkstemp(path.items);
+	if (scratch->fd >= 0) {
+		// programs started to compress files have no business with it
+		fcntl(scratch->fd, F_SETFD, FD_CLOEXEC);
+		unlink(path.items);
+	}
+	free(path.items);
+	return scratch->fd >= 0;
+}
+
+// Open the scratch file, in `$TMPDIR` if it's set, or else preferring
+// `/var/tmp` to `/tmp`, which is often a tmpfs that would keep the file in
+// memory.
+static bool sp_open(void)
+{
+	const char *dir = getenv("TMPDIR");
+	if (dir != NULL && *dir != '\0')
+		return sp_open_in(dir);
+	return sp_open_in("/var/tmp") || sp_open_in("/tmp");
+}
+
+// Free list for allocations of `size` bytes.
+static Sp_Free_List *sp_free_list(size_t size)
+{
+	Sp_Scratch *scratch = &sp_global_scratch;
+
+	da_foreach(list, scratch->free)
+	{
+		if (list->size == size)
+			return list;
+	}
+
+	Sp_Free_List list = { .size = size, .head = NULL };
+	da_append(&scratch->free, list);
+	return &scratch->free.items[scratch->free.count - 1];
+}
+
+// Segment `data` was allocated from, or `NULL` if it's from memory.
+static Sp_Segment *sp_segment(void *data)
+{
+	Sp_Scratch *scratch = &sp_global_scratch;
+
+	da_foreach(segment, scratch->segments)
+	{
+		if ((char *)data >= segment->data &&
+		    (char *)data < segment->data + segment->size)
+			return segment;
+	}
+	return NULL;
+}
+
+// Note that `size` bytes of `segment` were written to.
+static void sp_dirty(Sp_Segment *segment, size_t size)
+{
+	segment->dirty = true;
+	sp_global_scratch.dirty += size;
+}
+
+// Allocate `size` bytes set to 0 from the scratch file, reusing freed ones
+// where possible and growing the file otherwise.
+//
+// Returns `NULL` if the file can't grow.
+static void *sp_take(size_t size)
+{
+	Sp_Scratch *scratch = &sp_global_scratch;
+
+	Sp_Free_List *list = sp_free_list(size);
+	if (list->head != NULL) {
+		void *data = list->head;
+		memcpy(&list->head, data, sizeof(void *));
+		memset(data, 0, size);
+		sp_dirty(sp_segment(data), size);
+		return data;
+	}
+
+	Sp_Segment *segment =
+		scratch->segments.count > 0 ?
+			&scratch->segments.items[scratch->segments.count - 1] :
+			NULL;
+	if (segment == NULL || segment->size - segment->used < size) {
+		if (scratch->fd < 0 && !sp_open())
+			return NULL;
+
+		size_t grow = segment == NULL ? SP_SEGMENT_SIZE :
+						segment->size * 2;
+		while (grow < size)
+			grow *= 2;
+
+		// the room is set aside on disk up front, since running out
+		// of it once pages are written back would be fatal
+		if (posix_fallocate(scratch->fd, scratch->file_size, grow) != 0)
+			return NULL;
+		char *data = mmap(NULL, grow, PROT_READ | PROT_WRITE,
+				  MAP_SHARED, scratch->fd, scratch->file_size);
+		if (data == MAP_FAILED)
+			return NULL;
+		scratch->file_size += grow;
+
+		Sp_Segment new_segment = { .data = data,
+					   .size = grow,
+					   .used = 0,
+					   .dirty = false };
+		da_append(&scratch->segments, new_segment);
+		segment = &scratch->segments.items[scratch->segments.count - 1];
+	}
+
+	void *data = segment->data + segment->used;
+	segment->used += size;
+	sp_dirty(segment, size);
+	return data;
+}
+#endif // _WIN32
+
+void *sp_alloc(size_t size)
+{
+#ifndef _WIN32
+	Sp_Scratch *scratch = &sp_global_scratch;
+
+	if (scratch->budget > 0) {
+		size = (size + SP_ALIGN - 1) / SP_ALIGN * SP_ALIGN;
+
+		pthread_mutex_lock(&scratch->lock);
+		void *data = NULL;
+		if (scratch->used + size > scratch->budget)
+			data = sp_take(size);
+		// memory is used past the budget if nothing can be spilled
+		if (data == NULL)
+			scratch->used += size;
+		pthread_mutex_unlock(&scratch->lock);
+
+		if (data != NULL)
+			return data;
+	}
+#endif // _WIN32
+
+	void *data = calloc(1, size);
+	assert(data != NULL && "Could not allocate memory");
+	return data;
+}
+
+void sp_free(void *data, size_t size)
+{
+	if (data == NULL)
+		return;
+
+#ifndef _WIN32
+	Sp_Scratch *scratch = &sp_global_scratch;
+
+	if (scratch->budget > 0) {
+		size = (size + SP_ALIGN - 1) / SP_ALIGN * SP_ALIGN;
+
+		pthread_mutex_lock(&scratch->lock);
+		Sp_Segment *segment = sp_segment(data);
+		bool spilled = segment != NULL;
+		if (spilled) {
+			Sp_Free_List *list = sp_free_list(size);
+			memcpy(data, &list->head, sizeof(void *));
+			list->head = data;
+			sp_dirty(segment, size);
+		} else {
+			scratch->used -= size;
+		}
+		pthread_mutex_unlock(&scratch->lock);
+
+		if (spilled)
+			return;
+	}
+#else
+	(void)size;
+#endif // _WIN32
+
+	free(data);
+}
+
+void sp_evict(void)
+{
+#ifndef _WIN32
+	Sp_Scratch *scratch = &sp_global_scratch;
+
+	// the scratch file is left alone until what was written to it since
+	// it was last evicted would take memory past the budget
+	pthread_mutex_lock(&scratch->lock);
+	if (scratch->dirty > 0 &&
+	    scratch->used + scratch->dirty > scratch->budget) {
+		da_foreach(segment, scratch->segments)
+		{
+			if (!segment->dirty)
+				continue;
+			// dirty pages are dropped from `ed`'s memory and left
+			// for the system to write out whenever it likes, as
+			// the scratch file never has to be on disk
+#ifdef MADV_PAGEOUT
+			madvise(segment->data, segment->size, MADV_PAGEOUT);
+#else
+			madvise(segment->data, segment->size, MADV_DONTNEED);
+#endif // MADV_PAGEOUT
+			segment->dirty = false;
+		}
+		scratch->dirty = 0;
+	}
+	pthread_mutex_unlock(&scratch->lock);
+#endif // _WIN32
+}
+
+void sp_release(void)
+{
+#ifndef _WIN32
+	Sp_Scratch *scratch = &sp_global_scratch;
+
+	da_foreach(segment, scratch->segments)
+	{
+		munmap(segment->data, segment->size);
+	}
+	free(scratch->segments.items);
+	free(scratch->free.items);
+	memset(&scratch->segments, 0, sizeof(scratch->segments));
+	memset(&scratch->free, 0, sizeof(scratch->free));
+
+	if (scratch->fd >= 0)
+		close(scratch->fd);
+	scratch->fd = -1;
+	scratch->file_size = 0;
+	scratch->dirty = 0;
+	scratch->used = 0;
+#endif // _WIN32
+}
@@ -0,0 +1,50 @@
+#ifndef SP_H_
+#define SP_H_
+
+#include <stddef.h>
+
+// Spilling of the memory lines and their trees are kept in to a scratch file
+// once a budget is used up, as `ed` once kept its buffer in a scratch file.
+//
+// Memory past the budget is a shared mapping of the scratch file, which is
+// dropped from memory once what was written to it would take memory past the
+// budget, and read back in the moment it's touched again, keeping only what's
+// being worked on in memory however large the buffer gets.
+//
+// The scratch file lives in `$TMPDIR`, or `/var/tmp` if that isn't set, and
+// only spares memory if that's on a disk: a scratch file on a tmpfs is kept
+// in memory all the same, just out of the budget's reach.
+
+// Amount of bytes the scratch file first grows by, with each growth doubling
+// the last one so that few mappings are ever needed.
+#define SP_SEGMENT_SIZE (1 << 26)
+
+// Keep at most `budget` bytes in memory before spilling to a scratch file,
+// or never spill if 0.
+void sp_init(size_t budget);
+
+// Allocate `size` bytes set to 0, from memory while within the budget, or
+// from the scratch file past it.
+//
+// Safe to call from any thread.
+void *sp_alloc(size_t size);
+
+// Free the `size` bytes at `data` allocated with `sp_alloc`.
+//
+// Safe to call from any thread.
+void sp_free(void *data, size_t size);
+
+// Drop the parts of the scratch file written to since they were last dropped
+// from memory, until they're next touched, if they take memory past the
+// budget.
+//
+// Does nothing unless something was written to the scratch file since, so
+// that it can be called after every command.
+//
+// Safe to call from any thread.
+void sp_evict(void);
+
+// Free everything still in the scratch file, and the file itself.
+void sp_release(void);
+
+#endif // SP_H_
@@ -33,6 +33,31 @@ runtest() {
     fi
 }
 
+# GNU ed writes compressed files as they are, so a test writing one is also
+# run on its own and its file checked with the codec, when it's installed
+codectest() {
+    local tool="$1"
+    local path="$2"
+    TEST_NAME="$3 ($tool)"
+
+    if ! command -v "$tool" >/dev/null; then
+        printf "\n%-50s\033[0;33m SKIPPED\033[0m\n" "$TEST_NAME"
+        return
+    fi
+
+    rm -f "$path"
+    ./build/main < "$3" >/dev/null 2>&1
+    if "$tool" -t "$path" 2>/dev/null; then
+        printf "\n%-50s\033[0;32m SUCCESS\033[0m\n" "$TEST_NAME"
+    else
+        fail "$path compressed with $tool" "$path not compressed"
+    fi
+}
+
+# a file large enough to still be loading in the background when the commands
+# after `e` run
+seq 1 3000000 > /tmp/ed_large_file.txt
+
 for test_dir in ./tests/*; do
     for file in "$test_dir"/*; do
         if [[ "$(basename "$file")" != _* ]]; then
@@ -43,6 +68,8 @@ for test_dir in ./tests/*; do
     done
 done
 
+codectest gzip /tmp/ed_write_compressed.gz ./tests/write/compressed
+
 if [ $TESTS_FAILED -eq 0 ]; then
     printf "\nAll tests passed.\n"
     true